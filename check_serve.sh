@@ -0,0 +1,24 @@
+# Check that an image request to textonboost-serve gives the same scores as
+# the pipeline tool
+# usage: check_serve.sh classifier_file image_file dictionary [dictionary ...]
+BUILD=build/src
+CLASSIFIER=$1
+IMAGE=$2
+shift 2
+OUT=$(mktemp -d)
+TEXTONS=""
+DICTIONARIES=""
+for d in "$@"; do
+	TEXTONS="$TEXTONS --texton $d"
+	DICTIONARIES="$DICTIONARIES --dictionary $d"
+done
+$BUILD/pipeline $TEXTONS $CLASSIFIER $OUT $IMAGE || exit 1
+printf "image $OUT/serve.unary $IMAGE\nquit\n" | $BUILD/textonboost-serve $DICTIONARIES $CLASSIFIER || exit 1
+NAME=$(basename $IMAGE)
+if cmp $OUT/${NAME%.*}.unary $OUT/serve.unary; then
+	echo "serve and pipeline agree"
+	rm -r $OUT
+else
+	echo "serve and pipeline differ (see $OUT)"
+	exit 1
+fi
@@ -27,6 +27,27 @@
 
 #include "jointboost.h"
 
+void normalizeScores( Image< float >& r ) {
+	// TODO: maybe logistic regression is the way to go [with learned parameters]
+#ifndef RAW_BOOSTING_OUTPUT
+	const int C = r.depth();
+	for( int i=0; i<r.width()*r.height(); i++ ){
+		float * pr = r.data() + i*C;
+		double mx = pr[0];
+		for( int c=1; c<C; c++ )
+			if (pr[c] > mx)
+				mx = pr[c];
+		double tot = 0;
+		for( int c=0; c<C; c++ ){
+			pr[c] = exp( pr[c]-mx );
+			tot += pr[c];
+		}
+		for( int c=0; c<C; c++ )
+			pr[c] /= tot;
+	}
+#endif
+}
+
 double optimizeWeak( const QVector< double > & wi, const QVector< double > & wizi, int NT, const QVector<double> & kc, const QVector<double> & kc_num, const QVector<double> & kc_den, unsigned long long sharing, int * thres_id, double * r_a, double * r_b ) {
     // Precomputations
     double sum_wi = 0;
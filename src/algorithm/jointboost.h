@@ -30,15 +30,49 @@
 #include "config.h"
 #include "settings.h"
 #include <QVector>
+#include <QHash>
 #include <cmath>
+#include <cfloat>
 #include <QTime>
 
 #ifdef USE_TBB
 #include <tbb/task_scheduler_init.h>
 #include <tbb/parallel_reduce.h>
 #include <tbb/blocked_range.h>
+#include <tbb/blocked_range2d.h>
+#include <tbb/parallel_for.h>
 #endif
 
+// Settings for JointBoost::classify
+struct ClassifyOptions{
+	// Stop updating a tile (tile_size) once the margin between the top two
+	// classes of all its pixels exceeds the largest change all remaining
+	// rounds could cause
+	bool early_exit;
+	// Number of rounds between two early exit checks
+	int block_size;
+	// Stop all pixels after this many milliseconds (0 = no limit, early_exit only)
+	int time_budget;
+	// Split a single image into row bands or tiles and classify them in parallel
+	enum Parallel{
+		SERIAL,
+		ROW_BANDS,
+		TILES
+	};
+	Parallel parallel;
+	// Height of a row band or size of a tile (and of the early exit tiles)
+	int tile_size;
+	// Only use the first max_rounds rounds (0 = all), the bias round of a
+	// pruned model always comes first (see JointBoost::removeRounds)
+	int max_rounds;
+	ClassifyOptions():early_exit(false),block_size(100),time_budget(0),parallel(SERIAL),tile_size(32),max_rounds(0){
+	}
+};
+
+// Make the boosting scores something like a probability distribution
+// (does nothing if RAW_BOOSTING_OUTPUT is defined)
+void normalizeScores( Image<float> & r );
+
 // Optimize a weak classifier and return it's error
 double optimizeWeak( const QVector< double > & wi, const QVector< double > & wizi, int NT, const QVector<double> & kc, const QVector<double> & kc_num, const QVector<double> & kc_den, unsigned long long sharing, int * thres_id = NULL, double * r_a = NULL, double * r_b = NULL );
 
@@ -53,17 +87,17 @@ struct BoostRound{
 
 // Train a single random weak classifier
 template<typename W, typename D>
-BoostRound<W> trainSingle( const QVector<D> & data, const QVector< signed char > & gt, int n_classes, int n_thresholds, const QVector<double> & class_weight, const QVector<double> & kc, const QVector<double> & kc_num, const QVector<double> & kc_den ){
+BoostRound<W> trainSingle( const typename W::Context & context, const QVector<D> & data, const QVector< signed char > & gt, int n_classes, int n_thresholds, const QVector<double> & class_weight, const QVector<double> & kc, const QVector<double> & kc_num, const QVector<double> & kc_den ){
 	BoostRound<W> r;
 	r.error = 1e100;
 	r.a = r.b = 0;
 	// Generate a new weak classifier
-	r.weak = W::random();
+	r.weak = W::random( context );
 
 	// Compute all values
 	QVector< double > values( data.count() );
 	for( int i=0; i<data.count(); i++ )
-		values[i] = r.weak.value( data[i] );
+		values[i] = r.weak.value( context, data[i] );
 
 	// Compute min and max values
 	double min = values.first(), max = values.first();
@@ -142,6 +176,7 @@ BoostRound<W> trainSingle( const QVector<D> & data, const QVector< signed char >
 template<typename W, typename D>
 struct TBBTrainRound{
 	BoostRound<W> best;
+	const typename W::Context & context;
 	const QVector<D> & data;
 	const QVector< signed char > & gt;
 	int n_classes;
@@ -150,10 +185,10 @@ struct TBBTrainRound{
 	const QVector<double> & kc;
 	const QVector<double> & kc_num;
 	const QVector<double> & kc_den;
-	TBBTrainRound( const TBBTrainRound & o, tbb::split ):data(o.data),gt(o.gt),n_classes(o.n_classes),n_thresholds(o.n_thresholds),class_weight(o.class_weight),kc(o.kc),kc_num(o.kc_num),kc_den(o.kc_den){
+	TBBTrainRound( const TBBTrainRound & o, tbb::split ):context(o.context),data(o.data),gt(o.gt),n_classes(o.n_classes),n_thresholds(o.n_thresholds),class_weight(o.class_weight),kc(o.kc),kc_num(o.kc_num),kc_den(o.kc_den){
 		best.error = 1e100;
 	}
-	TBBTrainRound( const QVector<D> & data, const QVector< signed char > & gt, int n_classes, int n_thresholds, const QVector<double> & class_weight, const QVector<double> & kc, const QVector<double> & kc_num, const QVector<double> & kc_den ):data(data),gt(gt),n_classes(n_classes),n_thresholds(n_thresholds),class_weight(class_weight),kc(kc),kc_num(kc_num),kc_den(kc_den){
+	TBBTrainRound( const typename W::Context & context, const QVector<D> & data, const QVector< signed char > & gt, int n_classes, int n_thresholds, const QVector<double> & class_weight, const QVector<double> & kc, const QVector<double> & kc_num, const QVector<double> & kc_den ):context(context),data(data),gt(gt),n_classes(n_classes),n_thresholds(n_thresholds),class_weight(class_weight),kc(kc),kc_num(kc_num),kc_den(kc_den){
 		best.error = 1e100;
 	}
 	void join( const TBBTrainRound & o ){
@@ -164,7 +199,7 @@ struct TBBTrainRound{
 		// Text a number of weak classifiers
 		best.error = 1e100;
 		for( int i=rng.begin(); i<rng.end(); i++ ){
-			BoostRound<W> r = trainSingle<W,D>( data, gt, n_classes, n_thresholds, class_weight, kc, kc_num, kc_den );
+			BoostRound<W> r = trainSingle<W,D>( context, data, gt, n_classes, n_thresholds, class_weight, kc, kc_num, kc_den );
 			if (r.error < best.error)
 				best = r;
 		}
@@ -173,26 +208,28 @@ struct TBBTrainRound{
 
 // Train a single random weak classifier using tbb
 template<typename W, typename D>
-BoostRound<W> trainRound( const QVector<D> & data, const QVector< signed char > & gt, int n_classes, int n_classifiers, int n_thresholds, const QVector<double> & class_weight, const QVector<double> & kc, const QVector<double> & kc_num, const QVector<double> & kc_den ){
-	TBBTrainRound<W,D> rounds( data, gt, n_classes, n_thresholds, class_weight, kc, kc_num, kc_den );
+BoostRound<W> trainRound( const typename W::Context & context, const QVector<D> & data, const QVector< signed char > & gt, int n_classes, int n_classifiers, int n_thresholds, const QVector<double> & class_weight, const QVector<double> & kc, const QVector<double> & kc_num, const QVector<double> & kc_den ){
+	TBBTrainRound<W,D> rounds( context, data, gt, n_classes, n_thresholds, class_weight, kc, kc_num, kc_den );
 	tbb::parallel_reduce( tbb::blocked_range<int>(0, n_classifiers, 4), rounds );
 	return rounds.best;
 }
 #else
 // Train a single random weak classifier
 template<typename W, typename D>
-BoostRound<W> trainRound( const QVector<D> & data, const QVector< signed char > & gt, int n_classes, int n_classifiers, int n_thresholds, const QVector<double> & class_weight, const QVector<double> & kc, const QVector<double> & kc_num, const QVector<double> & kc_den ){
+BoostRound<W> trainRound( const typename W::Context & context, const QVector<D> & data, const QVector< signed char > & gt, int n_classes, int n_classifiers, int n_thresholds, const QVector<double> & class_weight, const QVector<double> & kc, const QVector<double> & kc_num, const QVector<double> & kc_den ){
 	// Text a number of weak classifiers
 	BoostRound<W> best;
 	best.error = 1e100;
 	for( int i=0; i<n_classifiers; i++ ){
-		BoostRound<W> r = trainSingle<W,D>( data, gt, n_classes, n_thresholds, class_weight, kc, kc_num, kc_den );
+		BoostRound<W> r = trainSingle<W,D>( context, data, gt, n_classes, n_thresholds, class_weight, kc, kc_num, kc_den );
 		if (r.error < best.error)
 			best = r;
 	}
 	return best;
 }
 #endif
+// W::Context holds the per model settings of the weak learners and is passed
+// to every call of W, so W itself has no global state
 template<typename W>
 class JointBoost
 {
@@ -204,10 +241,27 @@ protected:
 	QVector<unsigned long long> sharing_set_;
 	QVector< QVector<double> > kc_;
 	QVector< W > weak_learner_;
+	// Rounds grouped by weak learner filter (W::filter), rounds of the
+	// same group only differ in their threshold. Bias rounds are not grouped.
+	QVector< QVector<int> > filter_rounds_;
+	void groupFilters(){
+		filter_rounds_.clear();
+		QHash< typename W::Filter, int > group;
+		for( int k=0; k<num_rounds_; k++ ){
+			if (!sharing_set_[k])
+				continue;
+			const typename W::Filter f = weak_learner_[k].filter();
+			if (!group.contains( f )){
+				group.insert( f, filter_rounds_.count() );
+				filter_rounds_.append( QVector<int>() );
+			}
+			filter_rounds_[ group.value( f ) ].append( k );
+		}
+	}
 	
 public:
 template<typename D>
-	void train( const QVector<D> & data, const QVector< signed char > & gt, int n_classes, int n_rounds, int n_classifiers, int n_thresholds ){
+	void train( const typename W::Context & context, const QVector<D> & data, const QVector< signed char > & gt, int n_classes, int n_rounds, int n_classifiers, int n_thresholds ){
 		a_.clear();
 		b_.clear();
 		sharing_set_.clear();
@@ -242,7 +296,7 @@ template<typename D>
 			
 			timer.restart();
 			// Text a number of weak classifiers
-			BoostRound<W> best = trainRound<W,D>( data, gt, n_classes, n_classifiers, n_thresholds, class_weight, kc, kc_num, kc_den );
+			BoostRound<W> best = trainRound<W,D>( context, data, gt, n_classes, n_classifiers, n_thresholds, class_weight, kc, kc_num, kc_den );
 			t2 = timer.elapsed() / 1000.0; timer.restart();
 			
 			// Let's recompute a and b, just to be sure
@@ -250,7 +304,7 @@ template<typename D>
 			
 			tcw = class_weight.data();
 			for( int i=0; i<data.count(); i++ ){
-				bool cls = best.weak.classify( data[i] );
+				bool cls = best.weak.classify( context, data[i] );
                 for (int c = 0; c < num_classes_; c++, tcw++)
 					if(best.sharing_set & (1ll<<c)){
 						double wi = (*tcw);
@@ -271,7 +325,7 @@ template<typename D>
 			double error = 0;
 			tcw = class_weight.data();
 			for( int i=0; i<data.count(); i++ ){
-				double hm = best.weak.classify( data[i] ) ? (best.a+best.b) : best.b;
+				double hm = best.weak.classify( context, data[i] ) ? (best.a+best.b) : best.b;
                 for (int c = 0; c < num_classes_; c++, tcw++){
 					double hc = (best.sharing_set & (1ll<<c)) ? hm : kc[c];
 					double zi = gt[i] == c ? 1.0 : -1.0;
@@ -286,7 +340,7 @@ template<typename D>
 			sharing_set_.append( best.sharing_set );
 			kc_.append( kc );
 			// Finalize the weak learner [upsample, ...]
-			best.weak.finalize();
+			best.weak.finalize( context );
 			weak_learner_.append( best.weak );
 			qDebug("     err: %f (==%f) time: [%0.3f %0.3f %0.3f    %f]", best.error, error, t1, t2, timer.elapsed()/1000.0, t1+t2+timer.elapsed()/1000.0);
 			qDebug("     sset: 0x%llx a: %f (==%f) b: %f (==%f) rect: [%d %d - %d %d] thres: %f", best.sharing_set, best.a, a, best.b, b, best.weak.x1_, best.weak.y1_, best.weak.x2_, best.weak.y2_, best.weak.threshold_ );
@@ -294,58 +348,280 @@ template<typename D>
 // 				qFatal( "Oops fucked up! %f", (best.error-error) / (best.error+error) );
 // 			}
 		}
+		groupFilters();
 	}
 	
-template<typename I>
-	Image<float> classify( const I& int_im ) const{
-		float t0 = 0, t1 = 0;
-		Image<float> r( int_im.width(), int_im.height(), num_classes_ );
-		r.fill( 0 );
-		// Do the boosting
-		QTime timer;
-		Image<bool> cls( int_im.width(), int_im.height() );
+	// Remove all rounds with drop[k] set. The constant part of a removed round
+	// (b for the shared classes, kc otherwise) is folded into a bias round
+	// (empty sharing set), so only the response a is lost. The bias round is
+	// always the first round and its weak learner is never evaluated, so
+	// truncating the pruned model (max_rounds) keeps the constants of all
+	// removed rounds, including those after the truncation point.
+	void removeRounds( const QVector<bool> & drop ){
+		int bias = -1;
+		for( int k=0; k<num_rounds_ && bias<0; k++ )
+			if (!drop[k] && !sharing_set_[k])
+				bias = k;
+		QVector<double> a, b, bias_kc( num_classes_, 0.0 );
+		QVector<unsigned long long> sharing_set;
+		QVector< QVector<double> > kc;
+		QVector< W > weak_learner;
 		for( int k=0; k<num_rounds_; k++ ){
-			timer.start();
-			weak_learner_[k].fast_classify( int_im, cls );
-			t0 += timer.elapsed();timer.restart();
-			
-			QVector<double> kc = kc_[k];
-			unsigned long long sset = sharing_set_[k];
-			double ab = a_[k] + b_[k], b = b_[k];
+			if (drop[k]){
+				for( int c=0; c<num_classes_; c++ )
+					bias_kc[c] += ((1ll<<c)&sharing_set_[k]) ? b_[k] : kc_[k][c];
+				continue;
+			}
+			if (k == bias)
+				continue;
+			a.append( a_[k] );
+			b.append( b_[k] );
+			sharing_set.append( sharing_set_[k] );
+			kc.append( kc_[k] );
+			weak_learner.append( weak_learner_[k] );
+		}
+		if (bias >= 0 || a.count() < num_rounds_){
+			// Put the (possibly new) bias round first
+			const int k = bias >= 0 ? bias : drop.indexOf( true );
+			a.prepend( bias >= 0 ? a_[k] : 0 );
+			b.prepend( bias >= 0 ? b_[k] : 0 );
+			sharing_set.prepend( 0 );
+			kc.prepend( bias >= 0 ? kc_[k] : QVector<double>( num_classes_, 0.0 ) );
+			weak_learner.prepend( weak_learner_[k] );
+			for( int c=0; c<num_classes_; c++ )
+				kc[0][c] += bias_kc[c];
+		}
+		a_ = a;
+		b_ = b;
+		sharing_set_ = sharing_set;
+		kc_ = kc;
+		weak_learner_ = weak_learner;
+		num_rounds_ = a_.count();
+		groupFilters();
+	}
+	// Add the parameters of round j to round i (same sharing set) and remove j,
+	// call groupFilters() after the last merge
+	void mergeRounds( int i, int j ){
+		Q_ASSERT( sharing_set_[i] == sharing_set_[j] );
+		a_[i] += a_[j];
+		b_[i] += b_[j];
+		for( int c=0; c<num_classes_; c++ )
+			kc_[i][c] += kc_[j][c];
+		a_.remove( j );
+		b_.remove( j );
+		sharing_set_.remove( j );
+		kc_.remove( j );
+		weak_learner_.remove( j );
+		num_rounds_--;
+	}
+	
+public:
+	int numRounds() const{
+		return num_rounds_;
+	}
+	// Number of rounds used with the given options
+	int numRounds( const ClassifyOptions & options ) const{
+		return options.max_rounds > 0 ? qMin( options.max_rounds, num_rounds_ ) : num_rounds_;
+	}
+	// Early exit bounds and timer shared by all regions of one image
+	struct EarlyExit{
+		// Upper bound on how much rounds [k,n_rounds) can change the score
+		// difference of two classes (bound) and the score magnitude (magnitude)
+		QVector<double> bound, magnitude;
+		QTime timer;
+	};
+	void earlyExit( EarlyExit & e, int n_rounds ) const{
+		e.bound.fill( 0.0, n_rounds+1 );
+		e.magnitude.fill( 0.0, n_rounds+1 );
+		QVector<double> lo( num_classes_ ), hi( num_classes_ );
+		for( int k=n_rounds-1; k>=0; k-- ){
+			double ab = a_[k] + b_[k], b = b_[k], mx_abs = 0;
+			for( int c=0; c<num_classes_; c++ ){
+				if ((1ll<<c)&sharing_set_[k]){
+					lo[c] = qMin( ab, b );
+					hi[c] = qMax( ab, b );
+				}
+				else
+					lo[c] = hi[c] = kc_[k][c];
+				mx_abs = qMax( mx_abs, qMax( fabs(lo[c]), fabs(hi[c]) ) );
+			}
+			double mx_change = 0;
+			for( int c1=0; c1<num_classes_; c1++ )
+				for( int c2=0; c2<num_classes_; c2++ )
+					if (c1 != c2 && hi[c1]-lo[c2] > mx_change)
+						mx_change = hi[c1]-lo[c2];
+			e.bound[k] = e.bound[k+1] + mx_change;
+			e.magnitude[k] = e.magnitude[k+1] + mx_abs;
+		}
+		e.timer.start();
+	}
+	// Add the scores of all rounds for pixels [x0,x1)x[y0,y1) to r
+template<typename I>
+	void classifyRegion( const typename W::Context & context, const I& int_im, Image<float> & r, int x0, int y0, int x1, int y1, const ClassifyOptions & options, const EarlyExit & early_exit ) const{
+		if (options.early_exit)
+			classifyAnytime( context, int_im, r, x0, y0, x1, y1, options, early_exit );
+		else
+			classifyRounds( context, int_im, r, x0, y0, x1, y1, 0, numRounds( options ) );
+	}
+template<typename I>
+	Image<float> classify( const typename W::Context & context, const I& int_im, const ClassifyOptions & options = ClassifyOptions() ) const;
+protected:
+template<typename I>
+	void classifyAnytime( const typename W::Context & context, const I& int_im, Image<float> & r, int x0, int y0, int x1, int y1, const ClassifyOptions & options, const EarlyExit & early_exit ) const{
+		const QVector<double> & bound = early_exit.bound, & magnitude = early_exit.magnitude;
+		const int block_size = qMax( options.block_size, 1 ), tile_size = qMax( options.tile_size, 1 ), n_rounds = bound.count()-1;
+		// Tiles [x0,x1)x[y0,y1) that still have undecided pixels
+		QVector<int> active;
+		for( int j=y0; j<y1; j+=tile_size )
+			for( int i=x0; i<x1; i+=tile_size )
+				active << i << j << qMin( i+tile_size, x1 ) << qMin( j+tile_size, y1 );
+		for( int k0=0; k0<n_rounds && active.count()>0; k0+=block_size ){
+			const int k1 = qMin( k0+block_size, n_rounds );
+			for( int n=0; n<active.count(); n+=4 )
+				classifyRounds( context, int_im, r, active[n], active[n+1], active[n+2], active[n+3], k0, k1 );
+			if (options.time_budget > 0 && early_exit.timer.elapsed() >= options.time_budget)
+				break;
 			
-			float * rdata = r.data();
-			bool * cdata = cls.data();
-			for( int j=0; j<int_im.height(); j++ )
-				for( int i=0; i<int_im.width(); i++, cdata++ ){
-					double value = *cdata ? ab : b;
-					for( int c=0; c<num_classes_; c++, rdata++)
-						*rdata += ((1ll<<c)&sset) ? value : kc[c];
+			// Retire all tiles whose labels can't change anymore (leave some
+			// slack for the float rounding of the remaining rounds)
+			int n_active = 0;
+			for( int n=0; n<active.count(); n+=4 ){
+				bool decided = num_classes_ > 1;
+				for( int j=active[n+1]; j<active[n+3] && decided; j++ )
+					for( int i=active[n]; i<active[n+2] && decided; i++ ){
+						const float * rdata = r.data() + (j*r.width()+i)*num_classes_;
+						float s1 = -FLT_MAX, s2 = -FLT_MAX;
+						for( int c=0; c<num_classes_; c++ )
+							if (rdata[c] > s1){
+								s2 = s1;
+								s1 = rdata[c];
+							}
+							else if (rdata[c] > s2)
+								s2 = rdata[c];
+						double slack = (n_rounds-k1) * FLT_EPSILON * (qMax( fabs(s1), fabs(s2) ) + magnitude[k1]);
+						decided = s1 - s2 > bound[k1] + slack;
+					}
+				if (!decided)
+					for( int m=0; m<4; m++ )
+						active[n_active++] = active[n+m];
+			}
+			active.resize( n_active );
+		}
+	}
+public:
+	// Add the scores of the rounds [k0,k1) for pixels [x0,x1)x[y0,y1) to r
+template<typename I>
+	void classifyRounds( const typename W::Context & context, const I& int_im, Image<float> & r, int x0, int y0, int x1, int y1, int k0, int k1 ) const{
+		const int n_pixels = (x1-x0)*(y1-y0);
+		// Add the bias rounds
+		for( int k=k0; k<k1; k++ )
+			if (!sharing_set_[k])
+				for( int j=y0; j<y1; j++ ){
+					float * rdata = r.data() + (j*r.width()+x0)*num_classes_;
+					for( int i=x0; i<x1; i++ )
+						for( int c=0; c<num_classes_; c++, rdata++)
+							*rdata += kc_[k][c];
 				}
-			t1 += timer.elapsed();timer.restart();
+		
+		// Do the boosting
+		Image<bool> cls( x1-x0, y1-y0 );
+		if (filter_rounds_.isEmpty()){
+			for( int k=k0; k<k1; k++ )
+				if (sharing_set_[k]){
+					weak_learner_[k].fast_classify( context, int_im, cls, x0, y0, x1, y1 );
+					accumulate( cls, k, r, x0, y0, x1, y1 );
+				}
+			return;
 		}
-		qDebug("Classification time %f %f", t0, t1 );
-		// Make the result something like a probability distribution
-		// TODO: maybe logistic regression is the way to go [with learned parameters]
-#ifndef RAW_BOOSTING_OUTPUT
-		for( int j=0; j<int_im.height(); j++ )
-			for( int i=0; i<int_im.width(); i++ ){
-				double mx = r(i,j,0);
-				for( int c=1; c<num_classes_; c++ )
-					if (r(i,j,c) > mx)
-						mx = r(i,j,c);
-				for( int c=0; c<num_classes_; c++ )
-					r(i,j,c) = exp( r(i,j,c)-mx );
-				double tot = 0;
-				for( int c=0; c<num_classes_; c++ )
-					tot += r(i,j,c);
-				for( int c=0; c<num_classes_; c++ )
-					r(i,j,c) /= tot;
+		// Compute the response of every filter only once and threshold it
+		// for all rounds that use the filter
+		Image<double> response( x1-x0, y1-y0 );
+		QVector<int> rounds;
+		for( int f=0; f<filter_rounds_.count(); f++ ){
+			rounds.clear();
+			for( int n=0; n<filter_rounds_[f].count(); n++ )
+				if (k0 <= filter_rounds_[f][n] && filter_rounds_[f][n] < k1)
+					rounds.append( filter_rounds_[f][n] );
+			if (rounds.count() == 1){
+				weak_learner_[rounds.first()].fast_classify( context, int_im, cls, x0, y0, x1, y1 );
+				accumulate( cls, rounds.first(), r, x0, y0, x1, y1 );
 			}
-#endif
-		return r;
+			if (rounds.count() <= 1)
+				continue;
+			weak_learner_[rounds.first()].fast_response( context, int_im, response, x0, y0, x1, y1 );
+			for( int n=0; n<rounds.count(); n++ ){
+				const W & weak = weak_learner_[ rounds[n] ];
+				for( int i=0; i<n_pixels; i++ )
+					cls[i] = weak.classifyResponse( context, response[i] );
+				accumulate( cls, rounds[n], r, x0, y0, x1, y1 );
+			}
+		}
+	}
+protected:
+	// Add the result of round k for the pixels in [x0,x1)x[y0,y1) (cls) to r
+	void accumulate( const Image<bool> & cls, int k, Image<float> & r, int x0, int y0, int x1, int y1 ) const{
+		const QVector<double> & kc = kc_[k];
+		unsigned long long sset = sharing_set_[k];
+		double ab = a_[k] + b_[k], b = b_[k];
+		
+		const bool * cdata = cls.data();
+		for( int j=y0; j<y1; j++ ){
+			float * rdata = r.data() + (j*r.width()+x0)*num_classes_;
+			for( int i=x0; i<x1; i++, cdata++ ){
+				double value = *cdata ? ab : b;
+				for( int c=0; c<num_classes_; c++, rdata++)
+					*rdata += ((1ll<<c)&sset) ? value : kc[c];
+			}
+		}
+	}
+};
+
+#ifdef USE_TBB
+// Classify the row bands or tiles of a single image in parallel
+template<typename W, typename I>
+class TBBClassify{
+	const JointBoost<W> & booster;
+	const typename W::Context & context;
+	const I & int_im;
+	Image<float> & r;
+	const ClassifyOptions & options;
+	const typename JointBoost<W>::EarlyExit & early_exit;
+public:
+	TBBClassify( const JointBoost<W> & booster, const typename W::Context & context, const I & int_im, Image<float> & r, const ClassifyOptions & options, const typename JointBoost<W>::EarlyExit & early_exit ):booster(booster),context(context),int_im(int_im),r(r),options(options),early_exit(early_exit){
+	}
+	void operator()( const tbb::blocked_range<int> & rows ) const{
+		booster.classifyRegion( context, int_im, r, 0, rows.begin(), int_im.width(), rows.end(), options, early_exit );
+	}
+	void operator()( const tbb::blocked_range2d<int> & rng ) const{
+		booster.classifyRegion( context, int_im, r, rng.cols().begin(), rng.rows().begin(), rng.cols().end(), rng.rows().end(), options, early_exit );
 	}
-	
 };
+#endif
+
+template<typename W>
+template<typename I>
+Image<float> JointBoost<W>::classify( const typename W::Context & context, const I& int_im, const ClassifyOptions & options ) const{
+	Image<float> r( int_im.width(), int_im.height(), num_classes_ );
+	r.fill( 0 );
+	QTime timer;
+	timer.start();
+	EarlyExit early_exit;
+	if (options.early_exit)
+		earlyExit( early_exit, numRounds( options ) );
+	// Do the boosting
+#ifdef USE_TBB
+	const int tile_size = qMax( options.tile_size, 1 );
+	if (options.parallel == ClassifyOptions::ROW_BANDS)
+		tbb::parallel_for( tbb::blocked_range<int>(0, int_im.height(), tile_size), TBBClassify<W,I>( *this, context, int_im, r, options, early_exit ) );
+	else if (options.parallel == ClassifyOptions::TILES)
+		tbb::parallel_for( tbb::blocked_range2d<int>(0, int_im.height(), tile_size, 0, int_im.width(), tile_size), TBBClassify<W,I>( *this, context, int_im, r, options, early_exit ) );
+	else
+#endif
+		classifyRegion( context, int_im, r, 0, 0, int_im.width(), int_im.height(), options, early_exit );
+	qDebug("Classification time %d", timer.elapsed() );
+	normalizeScores( r );
+	return r;
+}
 
 template <typename W>
 QDataStream& operator<<( QDataStream & s, const JointBoost<W> & b ){
@@ -353,5 +629,7 @@ QDataStream& operator<<( QDataStream & s, const JointBoost<W> & b ){
 }
 template <typename W>
 QDataStream& operator>>( QDataStream & s, JointBoost<W> & b ){
-	return s >> b.num_rounds_ >> b.num_classes_ >> b.a_ >> b.b_ >> b.sharing_set_ >> b.kc_ >> b.weak_learner_;
+	s >> b.num_rounds_ >> b.num_classes_ >> b.a_ >> b.b_ >> b.sharing_set_ >> b.kc_ >> b.weak_learner_;
+	b.groupFilters();
+	return s;
 }
@@ -179,7 +179,7 @@ void KMeans::save(const QString& s) const {
 		qWarning( "Failed to write file '%s'", qPrintable( s ) );
 	else {
 		QDataStream s(&file);
-		s << center_ << feature_size_ << n_center_;
+		s << *this;
 		file.close();
 	}
 }
@@ -189,8 +189,16 @@ void KMeans::load(const QString& s) {
 		qWarning( "Failed to load file '%s'", qPrintable( s ) );
 	else {
 		QDataStream s(&file);
-		s >> center_ >> feature_size_ >> n_center_;
+		s >> *this;
 		file.close();
-		initAnn();
 	}
 }
+QDataStream& operator<<(QDataStream& s, const KMeans& k) {
+	return s << k.center_ << k.feature_size_ << k.n_center_;
+}
+QDataStream& operator>>(QDataStream& s, KMeans& k) {
+	s >> k.center_ >> k.feature_size_ >> k.n_center_;
+	// Build the tree now, the lazy initialization is not thread safe
+	k.initAnn();
+	return s;
+}
@@ -35,6 +35,8 @@
 class KMeans
 {
 protected:
+	friend QDataStream& operator<<( QDataStream & s, const KMeans & k );
+	friend QDataStream& operator>>( QDataStream & s, KMeans & k );
 	QVector< float > center_;
 	int feature_size_;
 	int n_center_;
@@ -58,3 +60,5 @@ public:
 	void load(const QString& s);
 	void save(const QString& s) const;
 };
+QDataStream& operator<<( QDataStream & s, const KMeans & k );
+QDataStream& operator>>( QDataStream & s, KMeans & k );
@@ -0,0 +1,70 @@
+/*
+    Copyright (c) 2011, Philipp Krähenbühl
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+        * Neither the name of the Stanford University nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY Philipp Krähenbühl ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL Philipp Krähenbühl BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "util/util.h"
+#include "util/dataset.h"
+#include "util/datasetcache.h"
+#include "settings.h"
+#include <QString>
+
+// Append the images to the cache as they are decoded
+class CacheWriter: public Dataset::Consumer{
+	const Dataset & dataset;
+	DatasetCacheWriter & cache;
+public:
+	CacheWriter( const Dataset & dataset, DatasetCacheWriter & cache ):dataset(dataset),cache(cache){}
+	void operator()( int i, const ColorImage & image, const LabelImage & labels ){
+		if (image.width() == 0 || image.height() == 0){
+			qWarning( "Failed to load '%s'", qPrintable( dataset.imageFile( i ) ) );
+			return;
+		}
+		cache.add( dataset.name( i ), image, dataset.imageFile( i ), labels, dataset.labelFile( i ) );
+	}
+};
+
+int main( int argc, char * argv[]){
+	if (argc>2){
+		qWarning( "Usage: %s [cache_file]", argv[0] );
+		qWarning( "     Decodes all images and labels into a dataset cache (default '%s')", DATASET_CACHE );
+		return 1;
+	}
+	const QString filename = argc>1 ? argv[1] : DATASET_CACHE;
+	// Decode, even if there already is a cache. Only a few images are in
+	// memory at once.
+	const Dataset dataset( ALL, Dataset::IMAGES_AND_LABELS, false );
+	DatasetCacheWriter cache;
+	if (!cache.open( filename ))
+		return 1;
+	CacheWriter writer( dataset, cache );
+	dataset.process( writer );
+	const int n = cache.count();
+	if (!cache.close())
+		return 1;
+	qDebug( "Cached %d images in '%s'", n, qPrintable( filename ) );
+	return 0;
+}
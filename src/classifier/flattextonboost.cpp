@@ -0,0 +1,233 @@
+/*
+    Copyright (c) 2011, Philipp Krähenbühl
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+        * Neither the name of the Stanford University nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY Philipp Krähenbühl ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL Philipp Krähenbühl BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "flattextonboost.h"
+#include <QTime>
+#include <cstring>
+
+static const char FLAT_MAGIC[8] = {'T','B','F','L','A','T','\0','\0'};
+static const int FLAT_VERSION = 2;
+static const int FLAT_BYTE_ORDER = 0x01020304;
+static const int FLAT_ALIGNMENT = 16;
+
+FlatTextonBoost::FlatTextonBoost():data_(NULL),header_(NULL) {
+}
+FlatTextonBoost::~FlatTextonBoost() {
+	unload();
+}
+void FlatTextonBoost::unload() {
+	if (data_)
+		file_.unmap( (uchar*)data_ );
+	file_.close();
+	data_ = NULL;
+	header_ = NULL;
+}
+bool FlatTextonBoost::isLoaded() const {
+	return header_ != NULL;
+}
+int FlatTextonBoost::numRounds() const {
+	return header_ ? header_->num_rounds : 0;
+}
+int FlatTextonBoost::numClasses() const {
+	return header_ ? header_->num_classes : 0;
+}
+int FlatTextonBoost::numChannels() const {
+	return header_ ? header_->num_offsets-1 : 0;
+}
+bool FlatTextonBoost::load(const QString& name) {
+	unload();
+	file_.setFileName( name );
+	if (!file_.open( QFile::ReadOnly )){
+		qWarning("Failed to load FlatTextonBoost from '%s'", qPrintable( name ) );
+		return false;
+	}
+	const qint64 size = file_.size();
+	if (size < (qint64)sizeof(FlatModelHeader)){
+		qWarning("'%s' is not a flat TextonBoost model", qPrintable( name ) );
+		unload();
+		return false;
+	}
+	data_ = file_.map( 0, size );
+	if (!data_){
+		qWarning("Failed to map '%s'", qPrintable( name ) );
+		unload();
+		return false;
+	}
+	const FlatModelHeader * h = (const FlatModelHeader *)data_;
+	if (memcmp( h->magic, FLAT_MAGIC, sizeof(FLAT_MAGIC) ) || h->version != FLAT_VERSION || h->byte_order != FLAT_BYTE_ORDER){
+		qWarning("'%s' is not a flat TextonBoost model (version %d) of this machine", qPrintable( name ), FLAT_VERSION );
+		unload();
+		return false;
+	}
+	// Check the counts first, so that the section sizes below can't overflow
+	// (sharing sets are 64 bit)
+	const qint64 n = h->num_rounds, c = h->num_classes;
+	if (n < 0 || c < 0 || c > 64 || h->num_offsets <= 0){
+		qWarning("'%s' is corrupted", qPrintable( name ) );
+		unload();
+		return false;
+	}
+	// Check that all sections fit into the file
+	const qint64 offsets[] = {h->texton_offset, h->x1, h->y1, h->x2, h->y2, h->t, h->threshold, h->a, h->b, h->sharing_set, h->bias, h->constant};
+	const qint64 counts[] = {h->num_offsets, n, n, n, n, n, n, n, n, n, c, n*c};
+	const int element_size[] = {sizeof(int), sizeof(int), sizeof(int), sizeof(int), sizeof(int), sizeof(int), sizeof(float), sizeof(double), sizeof(double), sizeof(quint64), sizeof(double), sizeof(double)};
+	for( unsigned int i=0; i<sizeof(offsets)/sizeof(offsets[0]); i++ )
+		if (offsets[i] < (qint64)sizeof(FlatModelHeader) || offsets[i] % FLAT_ALIGNMENT || offsets[i] > size || counts[i]*element_size[i] > size - offsets[i]){
+			qWarning("'%s' is corrupted", qPrintable( name ) );
+			unload();
+			return false;
+		}
+	// Check the values the classifier indexes with
+	bool valid = true;
+	const int * texton_offset = (const int *)((const char*)data_ + h->texton_offset);
+	for( int i=0; valid && i<h->num_offsets; i++ )
+		valid = texton_offset[i] >= 0 && (i == 0 || texton_offset[i] > texton_offset[i-1]);
+	const int * t = (const int *)((const char*)data_ + h->t);
+	for( int k=0; valid && k<n; k++ )
+		valid = t[k] >= 0 && t[k] < texton_offset[h->num_offsets-1];
+	if (!valid){
+		qWarning("'%s' is corrupted", qPrintable( name ) );
+		unload();
+		return false;
+	}
+	header_ = h;
+	return true;
+}
+
+// Append a section to the file and remember it's offset
+template<typename T>
+static void writeSection( QFile & file, qint64 & offset, const QVector<T> & v ){
+	static const char zeros[FLAT_ALIGNMENT] = {0};
+	file.write( zeros, (FLAT_ALIGNMENT - file.pos() % FLAT_ALIGNMENT) % FLAT_ALIGNMENT );
+	offset = file.pos();
+	file.write( (const char*)v.data(), v.count()*sizeof(T) );
+}
+bool FlatTextonBoost::save(const TextonBoost& booster, const QString& name) {
+	const int N = booster.num_rounds_, C = booster.num_classes_;
+	QVector< int > x1( N ), y1( N ), x2( N ), y2( N ), t( N );
+	QVector< float > threshold( N );
+	QVector< double > a( N ), b( N ), bias( C, 0.0 ), constant( N*C );
+	QVector< quint64 > sharing_set( N );
+	for( int k=0; k<N; k++ ){
+		const TextonClassifier & w = booster.weak_learner_[k];
+		x1[k] = w.x1_;
+		y1[k] = w.y1_;
+		x2[k] = w.x2_;
+		y2[k] = w.y2_;
+		t[k] = w.t_;
+		threshold[k] = w.threshold_;
+		a[k] = booster.a_[k];
+		b[k] = booster.b_[k];
+		sharing_set[k] = booster.sharing_set_[k];
+		// Fold the constant part of the round into the bias
+		for( int c=0; c<C; c++ ){
+			constant[k*C+c] = ((1ll<<c)&sharing_set[k]) ? b[k] : booster.kc_[k][c];
+			bias[c] += constant[k*C+c];
+		}
+	}
+	
+	QFile file( name );
+	if (!file.open( QFile::WriteOnly )){
+		qWarning("Failed to save FlatTextonBoost to '%s'", qPrintable( name ) );
+		return false;
+	}
+	FlatModelHeader h;
+	memset( &h, 0, sizeof(h) );
+	memcpy( h.magic, FLAT_MAGIC, sizeof(FLAT_MAGIC) );
+	h.version = FLAT_VERSION;
+	h.byte_order = FLAT_BYTE_ORDER;
+	h.num_rounds = N;
+	h.num_classes = C;
+	h.num_offsets = booster.texton_offset_.count();
+	// Write a placeholder header first and fill in the offsets at the end
+	file.write( (const char*)&h, sizeof(h) );
+	writeSection( file, h.texton_offset, booster.texton_offset_ );
+	writeSection( file, h.x1, x1 );
+	writeSection( file, h.y1, y1 );
+	writeSection( file, h.x2, x2 );
+	writeSection( file, h.y2, y2 );
+	writeSection( file, h.t, t );
+	writeSection( file, h.threshold, threshold );
+	writeSection( file, h.a, a );
+	writeSection( file, h.b, b );
+	writeSection( file, h.sharing_set, sharing_set );
+	writeSection( file, h.bias, bias );
+	writeSection( file, h.constant, constant );
+	file.seek( 0 );
+	bool ok = file.write( (const char*)&h, sizeof(h) ) == sizeof(h);
+	file.close();
+	return ok;
+}
+
+template<typename I>
+void FlatTextonBoost::classify(const I& int_im, int k, Image< float >& r) const {
+	const FlatModelHeader & h = *header_;
+	const int C = h.num_classes;
+	const int x1 = section<int>( h.x1 )[k], y1 = section<int>( h.y1 )[k], x2 = section<int>( h.x2 )[k], y2 = section<int>( h.y2 )[k], t = section<int>( h.t )[k];
+	const float threshold = section<float>( h.threshold )[k];
+	const double a = section<double>( h.a )[k];
+	const quint64 sset = section<quint64>( h.sharing_set )[k];
+	float * rdata = r.data();
+	for( int j=0; j<int_im.height(); j++ )
+		for( int i=0; i<int_im.width(); i++, rdata+=C )
+			if (rectValue( int_im, i+x1, j+y1, i+x2, j+y2, t ) > threshold)
+				for( int c=0; c<C; c++ )
+					if ((1ll<<c)&sset)
+						rdata[c] += a;
+}
+Image< float > FlatTextonBoost::evaluate(const Image< short >& textons, const EvaluateOptions & options) const {
+	if (!header_)
+		qFatal("FlatTextonBoost: No model loaded");
+	const FlatModelHeader & h = *header_;
+	QVector< int > texton_offset( h.num_offsets );
+	memcpy( texton_offset.data(), section<int>( h.texton_offset ), h.num_offsets*sizeof(int) );
+	IntegralHistogram int_hist( textons, texton_offset, 1, options.parallel != ClassifyOptions::SERIAL );
+	
+	QTime timer;
+	timer.start();
+	const int C = h.num_classes;
+	const int n_rounds = options.max_rounds > 0 ? qMin( options.max_rounds, h.num_rounds ) : h.num_rounds;
+	QVector< double > bias( C );
+	memcpy( bias.data(), section<double>( h.bias ), C*sizeof(double) );
+	if (n_rounds < h.num_rounds){
+		// Only the constants of the rounds used
+		const double * constant = section<double>( h.constant );
+		bias.fill( 0.0 );
+		for( int k=0; k<n_rounds; k++ )
+			for( int c=0; c<C; c++ )
+				bias[c] += constant[k*C+c];
+	}
+	Image<float> r( int_hist.width(), int_hist.height(), C );
+	for( int i=0; i<r.width()*r.height(); i++ )
+		for( int c=0; c<C; c++ )
+			r[i*C+c] = bias[c];
+	for( int k=0; k<n_rounds; k++ )
+		classify( int_hist, k, r );
+	qDebug("Classification time %d", timer.elapsed() );
+	normalizeScores( r );
+	return r;
+}
@@ -0,0 +1,82 @@
+/*
+    Copyright (c) 2011, Philipp Krähenbühl
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+        * Neither the name of the Stanford University nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY Philipp Krähenbühl ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL Philipp Krähenbühl BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "textonboost.h"
+#include <QFile>
+
+// Header of the flat model format. All sections are arrays of num_rounds
+// elements (num_classes for bias, num_offsets for texton_offset and
+// num_rounds*num_classes for constant), stored in native byte order and
+// aligned to 16 bytes.
+struct FlatModelHeader{
+	char magic[8];
+	int version;
+	// FLAT_BYTE_ORDER as written by the creating machine
+	int byte_order;
+	int num_rounds, num_classes, num_offsets, reserved;
+	// Byte offset of every section from the start of the file
+	qint64 texton_offset, x1, y1, x2, y2, t, threshold, a, b, sharing_set, bias;
+	// Constant part of every round, only needed to evaluate the first rounds
+	qint64 constant;
+};
+
+// TextonBoost model that is memory mapped from a flat file.
+// The constant part of all rounds is folded into bias, a round that fires
+// adds a to all classes in its sharing set. Loading does not parse or copy
+// anything, so several processes share the same pages.
+class FlatTextonBoost{
+protected:
+	QFile file_;
+	const uchar * data_;
+	const FlatModelHeader * header_;
+	template<typename T> const T * section( qint64 offset ) const{
+		return (const T*)(data_ + offset);
+	}
+	template<typename I> void classify( const I & int_im, int k, Image<float> & r ) const;
+private:
+	// Not copyable (the mapping belongs to file_)
+	FlatTextonBoost( const FlatTextonBoost & o );
+	FlatTextonBoost & operator=( const FlatTextonBoost & o );
+public:
+	FlatTextonBoost();
+	~FlatTextonBoost();
+	bool load( const QString & name );
+	void unload();
+	bool isLoaded() const;
+	int numRounds() const;
+	int numClasses() const;
+	// Number of texton channels (depth of the texton image)
+	int numChannels() const;
+	// Same output as TextonBoost::evaluate at full resolution, always uses an
+	// IntegralHistogram (only parallel and max_rounds are supported, see
+	// evaluate.cpp)
+	Image<float> evaluate( const Image< short >& textons, const EvaluateOptions & options = EvaluateOptions() ) const;
+	// Convert a TextonBoost model into a flat file
+	static bool save( const TextonBoost & booster, const QString & name );
+};
@@ -0,0 +1,112 @@
+/*
+    Copyright (c) 2011, Philipp Krähenbühl
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+        * Neither the name of the Stanford University nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY Philipp Krähenbühl ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL Philipp Krähenbühl BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "integralhistogram.h"
+#ifdef USE_TBB
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+
+class TBBCountBands{
+	IntegralHistogram & hist;
+	const Image< short > & texton;
+	const QVector< int > & texton_offset;
+	int subsample;
+public:
+	TBBCountBands( IntegralHistogram & hist, const Image< short > & texton, const QVector< int > & texton_offset, int subsample ):hist(hist),texton(texton),texton_offset(texton_offset),subsample(subsample){
+	}
+	void operator()( const tbb::blocked_range<int> & bands ) const{
+		hist.countBands( texton, texton_offset, subsample, bands.begin(), bands.end() );
+	}
+};
+#endif
+
+// Largest band we allow (as power of 2)
+static const int MAX_BAND_SHIFT = 6;
+
+IntegralHistogram::IntegralHistogram():width_(0), height_(0), depth_(0), band_shift_(0) {
+}
+IntegralHistogram::IntegralHistogram( const Image< short >& texton, const QVector< int >& texton_offset, int subsample, bool parallel ) {
+	width_ = (texton.width()-1)/subsample + 1;
+	height_ = (texton.height()-1)/subsample + 1;
+	depth_ = texton_offset.last();
+	
+	// A band may count at most 65535 textons of the same kind
+	int max_row_count = width_*subsample*subsample;
+	if (max_row_count > 0xffff)
+		qFatal( "IntegralHistogram: Image too wide (%d)", texton.width() );
+	for( band_shift_=0; band_shift_<MAX_BAND_SHIFT && (max_row_count<<(band_shift_+1)) <= 0xffff; band_shift_++ );
+	const int band_size = 1<<band_shift_;
+	const int n_bands = (height_-1)/band_size + 1;
+	
+	const int row_size = width_*depth_;
+	relative_.resize( height_*row_size );
+	base_.resize( n_bands*row_size );
+	
+	// Bands are independent except for their base, which is the sum of all
+	// bands above them
+#ifdef USE_TBB
+	if (parallel)
+		tbb::parallel_for( tbb::blocked_range<int>(0, n_bands), TBBCountBands( *this, texton, texton_offset, subsample ) );
+	else
+#endif
+		countBands( texton, texton_offset, subsample, 0, n_bands );
+	QVector< unsigned int > total( row_size, 0 );
+	for( int b=0; b<n_bands; b++ ){
+		unsigned int * pbase = base_.data() + b*row_size;
+		for( int i=0; i<row_size; i++ ){
+			unsigned int band = pbase[i];
+			pbase[i] = total[i];
+			total[i] += band;
+		}
+	}
+}
+void IntegralHistogram::countBands( const Image< short >& texton, const QVector< int >& texton_offset, int subsample, int b0, int b1 ) {
+	const int row_size = width_*depth_;
+	QVector< unsigned int > row( row_size ), band( row_size );
+	for( int b=b0; b<b1; b++ ){
+		band.fill( 0 );
+		unsigned short * prelative = relative_.data() + (b<<band_shift_)*row_size;
+		for( int j=(b<<band_shift_); j<((b+1)<<band_shift_) && j<height_; j++ ){
+			// Count
+			row.fill( 0 );
+			for( int jj=j*subsample; jj<(j+1)*subsample && jj<texton.height(); jj++ )
+				for( int i=0; i<texton.width(); i++ )
+					for( int k=0; k<texton.depth(); k++ )
+						row[ (i/subsample)*depth_ + texton_offset[k] + texton(i,jj,k) ] += 1;
+			// Integrate along the row
+			for( int i=depth_; i<row_size; i++ )
+				row[i] += row[i-depth_];
+			// and add it to the band
+			for( int i=0; i<row_size; i++, prelative++ ){
+				band[i] += row[i];
+				*prelative = band[i];
+			}
+		}
+		// Store the band total as base for now
+		memcpy( base_.data() + b*row_size, band.data(), row_size*sizeof(unsigned int) );
+	}
+}
@@ -0,0 +1,66 @@
+/*
+    Copyright (c) 2011, Philipp Krähenbühl
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+        * Neither the name of the Stanford University nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY Philipp Krähenbühl ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL Philipp Krähenbühl BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "util/image.h"
+#include "config.h"
+#include <QVector>
+
+// Integral histogram of texton counts with exact integer counts.
+// The image is split into horizontal bands of 2^band_shift_ rows. Each band
+// stores the integral of the row above it as 32 bit base, the rows inside a
+// band only store the count relative to that base as 16 bit integer. This
+// uses a little more than half the memory of an Image<float> integral image.
+class IntegralHistogram{
+protected:
+	int width_, height_, depth_, band_shift_;
+	QVector< unsigned short > relative_;
+	QVector< unsigned int > base_;
+	friend class TBBCountBands;
+	// Fill relative_ of the bands [b0,b1) and store each band total in base_
+	void countBands( const Image< short > & texton, const QVector< int > & texton_offset, int subsample, int b0, int b1 );
+public:
+	IntegralHistogram();
+	// If parallel is set the bands are counted in parallel (requires TBB)
+	IntegralHistogram( const Image< short > & texton, const QVector< int > & texton_offset, int subsample, bool parallel=false );
+	int width() const{
+		return width_;
+	}
+	int height() const{
+		return height_;
+	}
+	int depth() const{
+		return depth_;
+	}
+	unsigned int operator()( int i, int j, int k=0 ) const{
+		Q_ASSERT( 0 <= i && i < width_ );
+		Q_ASSERT( 0 <= j && j < height_ );
+		Q_ASSERT( 0 <= k && k < depth_ );
+		return base_[ depth_*(width_*(j>>band_shift_)+i)+k ] + relative_[ depth_*(width_*j+i)+k ];
+	}
+};
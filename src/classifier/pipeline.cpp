@@ -0,0 +1,63 @@
+/*
+    Copyright (c) 2011, Philipp Krähenbühl
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+        * Neither the name of the Stanford University nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY Philipp Krähenbühl ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL Philipp Krähenbühl BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "pipeline.h"
+#include "util/colorimage.h"
+
+void Pipeline::addTexton(QSharedPointer< Texton > texton) {
+	textons_.append( texton );
+}
+bool Pipeline::addTexton(const QString& dictionary_file) {
+	QSharedPointer< Texton > texton( new Texton() );
+	if (!texton->load( dictionary_file ))
+		return false;
+	addTexton( texton );
+	return true;
+}
+int Pipeline::numChannels() const {
+	return textons_.count();
+}
+bool Pipeline::loadClassifier(const QString& classifier_file) {
+	booster_.load( classifier_file );
+	if (booster_.numChannels() != textons_.count()){
+		qWarning( "The classifier expects %d texton channels, got %d dictionaries", booster_.numChannels(), textons_.count() );
+		return false;
+	}
+	return true;
+}
+void Pipeline::setOptions(const EvaluateOptions& options) {
+	options_ = options;
+}
+Image< short > Pipeline::textonize(const ColorImage& image, const QString& name) const {
+	QVector< const Texton * > textons;
+	foreach( const QSharedPointer< Texton > & t, textons_ )
+		textons.append( t.data() );
+	return mergeChannels( textonizeChannels( textons, image, name ) );
+}
+Image< float > Pipeline::evaluate(const ColorImage& image, const QString& name) const {
+	return booster_.evaluate( textonize( image, name ), options_ );
+}
@@ -0,0 +1,56 @@
+/*
+    Copyright (c) 2011, Philipp Krähenbühl
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+        * Neither the name of the Stanford University nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY Philipp Krähenbühl ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL Philipp Krähenbühl BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "textonboost.h"
+#include "feature/texton.h"
+#include <QSharedPointer>
+
+class ColorImage;
+
+// Raw image to unaries entirely in memory: Lab conversion, one texton
+// channel per dictionary (feature, whitening and k-means assignment) and
+// TextonBoost evaluation
+class Pipeline{
+protected:
+	QVector< QSharedPointer< Texton > > textons_;
+	TextonBoost booster_;
+	EvaluateOptions options_;
+public:
+	// Add a texton channel (in the order the classifier was trained with)
+	void addTexton( QSharedPointer< Texton > texton );
+	// Add a dictionary saved by textonize (it stores it's own feature)
+	bool addTexton( const QString & dictionary_file );
+	// Number of texton channels (dictionaries)
+	int numChannels() const;
+	bool loadClassifier( const QString & classifier_file );
+	void setOptions( const EvaluateOptions & options );
+	
+	Image< short > textonize( const ColorImage & image, const QString & name = QString() ) const;
+	Image< float > evaluate( const ColorImage & image, const QString & name = QString() ) const;
+};
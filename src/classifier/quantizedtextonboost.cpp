@@ -0,0 +1,259 @@
+/*
+    Copyright (c) 2011, Philipp Krähenbühl
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+        * Neither the name of the Stanford University nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY Philipp Krähenbühl ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL Philipp Krähenbühl BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "quantizedtextonboost.h"
+#include <QFile>
+#include <QTime>
+#include <cmath>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Largest shift of the threshold mantissa (count<<shift has to fit into 64 bit)
+static const int MAX_THRESHOLD_SHIFT = 40;
+// Largest number of classes (sharing sets are 64 bit)
+static const int MAX_CLASSES = 64;
+
+QDataStream& operator<<(QDataStream& s, const QuantizedRound& r) {
+	return s << r.x1 << r.y1 << r.x2 << r.y2 << r.t << r.count_threshold << r.threshold_mantissa << r.threshold_shift;
+}
+QDataStream& operator>>(QDataStream& s, QuantizedRound& r) {
+	return s >> r.x1 >> r.y1 >> r.x2 >> r.y2 >> r.t >> r.count_threshold >> r.threshold_mantissa >> r.threshold_shift;
+}
+
+QuantizedTextonBoost::QuantizedTextonBoost():num_classes_(0),scale_(1) {
+}
+QuantizedTextonBoost::QuantizedTextonBoost(const TextonBoost& booster) {
+	quantize( booster );
+}
+int QuantizedTextonBoost::padded_classes() const {
+	return (num_classes_+7) & ~7;
+}
+int QuantizedTextonBoost::numRounds() const {
+	return rounds_.count();
+}
+int QuantizedTextonBoost::numChannels() const {
+	return texton_offset_.count()-1;
+}
+int QuantizedTextonBoost::modelSize() const {
+	return texton_offset_.count()*sizeof(int) + bias_.count()*sizeof(int) + rounds_.count()*sizeof(QuantizedRound) + delta_.count()*sizeof(short) + constant_.count()*sizeof(int);
+}
+void QuantizedTextonBoost::quantize(const TextonBoost& booster) {
+	texton_offset_ = booster.texton_offset_;
+	num_classes_ = booster.num_classes_;
+	if (num_classes_ > MAX_CLASSES)
+		qFatal( "QuantizedTextonBoost: Too many classes (%d)", num_classes_ );
+	const int n_rounds = booster.num_rounds_, P = padded_classes();
+	
+	// Fold the constant part of every round into the bias
+	QVector< double > bias( num_classes_, 0.0 ), delta( n_rounds*P, 0.0 ), constant( n_rounds*num_classes_, 0.0 );
+	double max_delta = 0;
+	for( int k=0; k<n_rounds; k++ ){
+		unsigned long long sset = booster.sharing_set_[k];
+		for( int c=0; c<num_classes_; c++ ){
+			if ((1ll<<c)&sset){
+				constant[k*num_classes_+c] = booster.b_[k];
+				delta[k*P+c] = booster.a_[k];
+				max_delta = qMax( max_delta, fabs( booster.a_[k] ) );
+			}
+			else
+				constant[k*num_classes_+c] = booster.kc_[k][c];
+			bias[c] += constant[k*num_classes_+c];
+		}
+	}
+	// Pick the largest scale such that every delta fits into 16 bit and no
+	// score can overflow 32 bit
+	double max_score = 0;
+	for( int c=0; c<num_classes_; c++ ){
+		double s = fabs( bias[c] );
+		for( int k=0; k<n_rounds; k++ )
+			s += fabs( delta[k*P+c] );
+		max_score = qMax( max_score, s );
+	}
+	scale_ = 1;
+	if (max_score > 0)
+		scale_ = (1<<30) / max_score;
+	if (max_delta > 0)
+		scale_ = qMin( (double)scale_, 32767. / max_delta );
+	
+	bias_.resize( P );
+	bias_.fill( 0 );
+	for( int c=0; c<num_classes_; c++ )
+		bias_[c] = (int)floor( bias[c]*scale_ + 0.5 );
+	delta_.resize( n_rounds*P );
+	for( int i=0; i<delta.count(); i++ )
+		delta_[i] = (short)floor( delta[i]*scale_ + 0.5 );
+	constant_.resize( n_rounds*num_classes_ );
+	for( int i=0; i<constant.count(); i++ )
+		constant_[i] = (int)qBound( -2147483647.0, floor( constant[i]*scale_ + 0.5 ), 2147483647.0 );
+	
+	// Quantize the weak learners
+	rounds_.resize( n_rounds );
+	for( int k=0; k<n_rounds; k++ ){
+		const TextonClassifier & w = booster.weak_learner_[k];
+		QuantizedRound & r = rounds_[k];
+		r.x1 = w.x1_;
+		r.y1 = w.y1_;
+		r.x2 = w.x2_;
+		r.y2 = w.y2_;
+		r.t = w.t_;
+		// count / area > threshold  <=>  count > floor( threshold*area )
+		double area = (w.x2_-w.x1_)*(w.y2_-w.y1_);
+		r.count_threshold = (int)qBound( -1.0, floor( w.threshold_*area ), 2147483647.0 );
+		// threshold = mantissa * 2^-shift with a 24 bit mantissa
+		int e;
+		double f = frexp( w.threshold_, &e );
+		r.threshold_mantissa = (int)ldexp( f, 24 );
+		r.threshold_shift = 24 - e;
+		if (r.threshold_shift < 0)
+			qFatal( "QuantizedTextonBoost: Threshold too large (%f)", w.threshold_ );
+		if (r.threshold_shift > MAX_THRESHOLD_SHIFT){
+			// Any non empty box is larger than such a small threshold
+			r.threshold_mantissa = w.threshold_ < 0 ? -1 : 0;
+			r.threshold_shift = 0;
+		}
+	}
+}
+void QuantizedTextonBoost::accumulate(const IntegralHistogram& int_hist, int k, Image< int >& score) const {
+	const QuantizedRound & r = rounds_[k];
+	const int W = int_hist.width(), H = int_hist.height(), P = padded_classes();
+	const long long full_area = (r.x2-r.x1)*(r.y2-r.y1);
+#ifdef __SSE2__
+	// Widen the 16 bit deltas once per round
+	__m128i delta[MAX_CLASSES/4];
+	for( int c=0; c<P; c+=8 ){
+		__m128i d = _mm_loadu_si128( (const __m128i*)(delta_.data() + k*P + c) );
+		delta[c/4  ] = _mm_srai_epi32( _mm_unpacklo_epi16( d, d ), 16 );
+		delta[c/4+1] = _mm_srai_epi32( _mm_unpackhi_epi16( d, d ), 16 );
+	}
+#else
+	const short * delta = delta_.data() + k*P;
+#endif
+	int * pscore = score.data();
+	for( int j=0; j<H; j++ ){
+		const int y1 = qMax( j+r.y1, 0 ), y2 = qMin( j+r.y2, H );
+		for( int i=0; i<W; i++, pscore+=P ){
+			const int x1 = qMax( i+r.x1, 0 ), x2 = qMin( i+r.x2, W );
+			bool fires;
+			if (x1 >= x2 || y1 >= y2)
+				fires = r.threshold_mantissa < 0;
+			else{
+				// Box count
+				long long count = int_hist(x2-1,y2-1,r.t);
+				if (x1>0)         count -= int_hist(x1-1,y2-1,r.t);
+				if (y1>0)         count -= int_hist(x2-1,y1-1,r.t);
+				if (x1>0 && y1>0) count += int_hist(x1-1,y1-1,r.t);
+				const long long area = (x2-x1)*(y2-y1);
+				if (area == full_area)
+					fires = count > r.count_threshold;
+				else
+					fires = (count << r.threshold_shift) > r.threshold_mantissa*area;
+			}
+			if (!fires)
+				continue;
+#ifdef __SSE2__
+			for( int c=0; c<P; c+=4 ){
+				__m128i * ps = (__m128i*)(pscore + c);
+				_mm_store_si128( ps, _mm_add_epi32( _mm_load_si128( ps ), delta[c/4] ) );
+			}
+#else
+			for( int c=0; c<P; c++ )
+				pscore[c] += delta[c];
+#endif
+		}
+	}
+}
+Image< int > QuantizedTextonBoost::scores(const Image< short >& textons, int max_rounds) const {
+	const int n_rounds = max_rounds > 0 ? qMin( max_rounds, rounds_.count() ) : rounds_.count();
+	QVector< int > bias = bias_;
+	if (n_rounds < rounds_.count()){
+		// Only the constants of the rounds used
+		if (constant_.count() == rounds_.count()*num_classes_){
+			for( int c=0; c<num_classes_; c++ ){
+				long long b = 0;
+				for( int k=0; k<n_rounds; k++ )
+					b += constant_[k*num_classes_+c];
+				bias[c] = (int)qBound( -2147483647ll, b, 2147483647ll );
+			}
+		}
+		else{
+			static bool warned = false;
+			if (!warned)
+				qWarning( "QuantizedTextonBoost: The model has no per round constants (quantize it again), the constants of all rounds are used" );
+			warned = true;
+		}
+	}
+	IntegralHistogram int_hist( textons, texton_offset_, 1 );
+	const int P = padded_classes();
+	Image<int> r( int_hist.width(), int_hist.height(), P );
+	for( int i=0; i<int_hist.width()*int_hist.height(); i++ )
+		memcpy( r.data()+i*P, bias.data(), P*sizeof(int) );
+	for( int k=0; k<n_rounds; k++ )
+		accumulate( int_hist, k, r );
+	return r;
+}
+Image< float > QuantizedTextonBoost::evaluate(const Image< short >& textons, const EvaluateOptions & options) const {
+	QTime timer;
+	timer.start();
+	Image<int> score = scores( textons, options.max_rounds );
+	qDebug("Classification time %d", timer.elapsed() );
+	
+	const int P = padded_classes();
+	Image<float> r( score.width(), score.height(), num_classes_ );
+	for( int i=0; i<score.width()*score.height(); i++ )
+		for( int c=0; c<num_classes_; c++ )
+			r[i*num_classes_+c] = score[i*P+c] / scale_;
+	normalizeScores( r );
+	return r;
+}
+QDataStream& operator<<(QDataStream& s, const QuantizedTextonBoost& b) {
+	return s << b.texton_offset_ << b.num_classes_ << b.scale_ << b.bias_ << b.rounds_ << b.delta_ << b.constant_;
+}
+QDataStream& operator>>(QDataStream& s, QuantizedTextonBoost& b) {
+	s >> b.texton_offset_ >> b.num_classes_ >> b.scale_ >> b.bias_ >> b.rounds_ >> b.delta_;
+	// Older models end here
+	b.constant_.clear();
+	if (!s.atEnd())
+		s >> b.constant_;
+	return s;
+}
+void QuantizedTextonBoost::save(const QString& name) {
+	QFile file(name);
+	if (!file.open( QFile::WriteOnly ))
+		qWarning("Failed to save QuantizedTextonBoost to '%s'", qPrintable( name ) );
+	QDataStream s( &file );
+	s << *this;
+	file.close();
+}
+void QuantizedTextonBoost::load(const QString& name) {
+	QFile file(name);
+	if (!file.open( QFile::ReadOnly ))
+		qWarning("Failed to load QuantizedTextonBoost from '%s'", qPrintable( name ) );
+	QDataStream s( &file );
+	s >> *this;
+	file.close();
+}
@@ -0,0 +1,85 @@
+/*
+    Copyright (c) 2011, Philipp Krähenbühl
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+        * Neither the name of the Stanford University nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY Philipp Krähenbühl ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL Philipp Krähenbühl BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "textonboost.h"
+
+// A single quantized boosting round
+struct QuantizedRound{
+	short x1, y1, x2, y2;
+	int t;
+	// The round fires if the box count is larger than count_threshold (box
+	// inside the image) or if count<<threshold_shift > threshold_mantissa*area
+	// (box clipped), both are exact for float thresholds
+	int count_threshold, threshold_mantissa, threshold_shift;
+};
+QDataStream& operator<<( QDataStream & s, const QuantizedRound & r );
+QDataStream& operator>>( QDataStream & s, QuantizedRound & r );
+
+// Integer only version of TextonBoost (full resolution only).
+// The constant part of all rounds is folded into a per class bias, a round
+// that fires adds its 16 bit fixed point delta to all classes it shares.
+// The scores are accumulated as 32 bit integers (using SSE2 if available).
+class QuantizedTextonBoost{
+protected:
+	friend QDataStream& operator<<( QDataStream & s, const QuantizedTextonBoost & b );
+	friend QDataStream& operator>>( QDataStream & s, QuantizedTextonBoost & b );
+	QVector< int > texton_offset_;
+	int num_classes_;
+	// Fixed point scale of all scores
+	float scale_;
+	QVector< int > bias_;
+	QVector< QuantizedRound > rounds_;
+	// num_classes_ rounded up to 8, delta_ stores padded_classes() values per round
+	QVector< short > delta_;
+	// Fixed point constant part of every round (num_classes_ per round), only
+	// needed to evaluate the first rounds (empty in older models)
+	QVector< int > constant_;
+	int padded_classes() const;
+	void accumulate( const IntegralHistogram & int_hist, int k, Image<int> & score ) const;
+public:
+	QuantizedTextonBoost();
+	explicit QuantizedTextonBoost( const TextonBoost & booster );
+	void quantize( const TextonBoost & booster );
+	int numRounds() const;
+	// Number of texton channels (depth of the texton image)
+	int numChannels() const;
+	// Raw fixed point scores (padded_classes() channels) of the first
+	// max_rounds rounds (0 = all)
+	Image<int> scores( const Image< short >& textons, int max_rounds = 0 ) const;
+	// Same output as TextonBoost::evaluate (only max_rounds is supported, always
+	// uses an IntegralHistogram at full resolution, see evaluate.cpp)
+	Image<float> evaluate( const Image< short >& textons, const EvaluateOptions & options = EvaluateOptions() ) const;
+	// Memory used by the model in bytes
+	int modelSize() const;
+	void save( const QString & name );
+	void load( const QString & name );
+};
+
+QDataStream& operator<<( QDataStream & s, const QuantizedTextonBoost & b );
+QDataStream& operator>>( QDataStream & s, QuantizedTextonBoost & b );
@@ -30,28 +30,14 @@
 #include <util/labelimage.h>
 
 /**** Data ****/
-TextonData::TextonData(const Image< float >* int_image, int x, int y) :int_image_(int_image), x_(x), y_(y) {
+TextonData::TextonData(const Image< float >* int_image, int x, int y) :int_image_(int_image), int_hist_(NULL), x_(x), y_(y) {
+}
+TextonData::TextonData(const IntegralHistogram* int_hist, int x, int y) :int_image_(NULL), int_hist_(int_hist), x_(x), y_(y) {
 }
 double TextonData::value(int x1, int y1, int x2, int y2, int t) const {
-    x1 += x_;
-    x2 += x_;
-    y1 += y_;
-    y2 += y_;
-	if (x1 >= int_image_->width() || x2 <= 0 || y1 >= int_image_->height() || y2 <= 0)
-		return 0;
-    
-	// Make the coords fit
-	if (x1 < 0) x1 = 0;
-	if (y1 < 0) y1 = 0;
-	if (x2 > int_image_->width() ) x2 = int_image_->width();
-	if (y2 > int_image_->height()) y2 = int_image_->height();
-	
-	// Sum up the rect
-	double r = (*int_image_)(x2-1,y2-1,t);
-	if (x1>0)         r -= (*int_image_)(x1-1,y2-1,t);
-	if (y1>0)         r -= (*int_image_)(x2-1,y1-1,t);
-	if (x1>0 && y1>0) r += (*int_image_)(x1-1,y1-1,t);
-	return r / ((x2-x1)*(y2-y1));
+	if (int_hist_)
+		return rectValue( *int_hist_, x1+x_, y1+y_, x2+x_, y2+y_, t );
+	return rectValue( *int_image_, x1+x_, y1+y_, x2+x_, y2+y_, t );
 }
 
 
@@ -75,88 +61,140 @@ static double gaussRange( double stddev2 ){
 }
 
 /**** Weak Classifier ****/
-int TextonClassifier::sub_sample_factor_ = 1;
-QVector< int > TextonClassifier::texton_offset_ = QVector< int >()<<400;
-int TextonClassifier::min_rect_size_ = 5;
-int TextonClassifier::max_rect_size_ = 100;
-TextonClassifier TextonClassifier::random() {
+TextonClassifier TextonClassifier::random( const TextonContext & context ) {
     TextonClassifier r;
+	const int min_rect_size = context.min_rect_size, max_rect_size = context.max_rect_size;
+	const QVector< int > & texton_offset = context.texton_offset;
 	// Randomly pick the rectangle
 #ifdef AREA_SAMPLING
 	// Rect size sampling proportional to the area of the final rectangle
-	double area = min_rect_size_*min_rect_size_ + (max_rect_size_*max_rect_size_ - min_rect_size_*min_rect_size_) * 1.0 * ::random() / RAND_MAX;
-	int mnw = ceil( qMax( (double)min_rect_size_, area / max_rect_size_ ) );
-	int mxw = floor( qMin( (double)max_rect_size_, area / min_rect_size_ ) );
+	double area = min_rect_size*min_rect_size + (max_rect_size*max_rect_size - min_rect_size*min_rect_size) * 1.0 * ::random() / RAND_MAX;
+	int mnw = ceil( qMax( (double)min_rect_size, area / max_rect_size ) );
+	int mxw = floor( qMin( (double)max_rect_size, area / min_rect_size ) );
 	int w = mnw + ::random()%(mxw-mnw+1);
     int h = round( area / w );
 	if (::random()&1)
 		qSwap( w, h );
 #else
 	// Uniform sampling for rect size
-    int w = min_rect_size_ + (::random() % (max_rect_size_-min_rect_size_+1));
-    int h = min_rect_size_ + (::random() % (max_rect_size_-min_rect_size_+1));
+    int w = min_rect_size + (::random() % (max_rect_size-min_rect_size+1));
+    int h = min_rect_size + (::random() % (max_rect_size-min_rect_size+1));
 #endif
 #ifdef GAUSSIAN_OFFSET
 	// Gaussian position sampling for rect
-    int x = gaussRange(max_rect_size_-w);
-    int y = gaussRange(max_rect_size_-h);
+    int x = gaussRange(max_rect_size-w);
+    int y = gaussRange(max_rect_size-h);
 #else
 	// Unary position sampling for rect
-    int x = ::random() % (max_rect_size_-w+1);
-    int y = ::random() % (max_rect_size_-h+1);
+    int x = ::random() % (max_rect_size-w+1);
+    int y = ::random() % (max_rect_size-h+1);
 #endif
-    r.x1_ = x - max_rect_size_/2;
-    r.y1_ = y - max_rect_size_/2;
+    r.x1_ = x - max_rect_size/2;
+    r.y1_ = y - max_rect_size/2;
     r.x2_ = r.x1_+w;
     r.y2_ = r.y1_+h;
 	
 	// Pick a random channel
-	int c = ::random() % (texton_offset_.count()-1);
+	int c = ::random() % (texton_offset.count()-1);
 	
-	int mn = texton_offset_[c];
-	int mx = texton_offset_[c+1];
+	int mn = texton_offset[c];
+	int mx = texton_offset[c+1];
 	// Randomly pick the texton
 	r.t_ = mn + (::random()%(mx-mn));
 	
 	return r;
 }
-double TextonClassifier::value(const TextonData& data) const {
+double TextonClassifier::value(const TextonContext& c, const TextonData& data) const {
 	// Dont forget to correct for the smaller area in the normalization
-    return data.value( x1_, y1_, x2_, y2_, t_ ) / (sub_sample_factor_*sub_sample_factor_);
+    return data.value( x1_, y1_, x2_, y2_, t_ ) / (c.sub_sample_factor*c.sub_sample_factor);
 }
-Image<float> TextonClassifier::value(const Image<float>& im) const {
+Image<float> TextonClassifier::value(const TextonContext& c, const Image<float>& im) const {
 	// Dont forget to correct for the smaller area in the normalization
 	Image<float> r( im.width(), im.height() );
 	for( int j=0; j<im.height(); j++ )
 		for( int i=0; i<im.width(); i++ )
-			r(i,j) = TextonData( &im, i, j ).value( x1_, y1_, x2_, y2_, t_ ) / (sub_sample_factor_*sub_sample_factor_);
+			r(i,j) = TextonData( &im, i, j ).value( x1_, y1_, x2_, y2_, t_ ) / (c.sub_sample_factor*c.sub_sample_factor);
 	return r;
 }
-bool TextonClassifier::classify(const TextonData& data) const {
-    return value(data) > threshold_;
+bool TextonClassifier::classify(const TextonContext& c, const TextonData& data) const {
+    return value( c, data ) > threshold_;
 }
-Image<bool> TextonClassifier::classify(const Image<float>& im) const {
+Image<bool> TextonClassifier::classify(const TextonContext& c, const Image<float>& im) const {
 	Image<bool> r( im.width(), im.height() );
 	bool * rdata = r.data();
 	for( int j=0; j<im.height(); j++ )
 		for( int i=0; i<im.width(); i++, rdata++ )
-			*rdata = TextonData( &im, i, j ).value( x1_, y1_, x2_, y2_, t_ ) > threshold_*(sub_sample_factor_*sub_sample_factor_);
+			*rdata = TextonData( &im, i, j ).value( x1_, y1_, x2_, y2_, t_ ) > threshold_*(c.sub_sample_factor*c.sub_sample_factor);
 	return r;
 }
-void TextonClassifier::fast_classify(const Image<float>& im, Image<bool> & r) const {
+// Round towards -infinity and +infinity (the rectangles are centered around
+// the pixel), a scaled rectangle covers all cells it touches
+static inline int floorDiv( int a, int b ){
+	return a >= 0 ? a / b : -((b-1-a) / b);
+}
+static inline int ceilDiv( int a, int b ){
+	return -floorDiv( -a, b );
+}
+template<typename I>
+static void fastClassify( const TextonClassifier & c, const I & im, Image<bool> & r, int x0, int y0, int x1, int y1, int s ){
+	// The rectangles are stored at full resolution, scale them to the integral image
+	const double threshold = c.threshold_*(s*s);
+	const int rx1 = floorDiv( c.x1_, s ), ry1 = floorDiv( c.y1_, s ), rx2 = ceilDiv( c.x2_, s ), ry2 = ceilDiv( c.y2_, s );
 	bool * rdata = r.data();
-	for( int j=0; j<im.height(); j++ )
-		for( int i=0; i<im.width(); i++, rdata++ )
-			*rdata = TextonData( &im, i, j ).value( x1_, y1_, x2_, y2_, t_ ) > threshold_*(sub_sample_factor_*sub_sample_factor_);
+	for( int j=y0; j<y1; j++ )
+		for( int i=x0; i<x1; i++, rdata++ )
+			*rdata = rectValue( im, i+rx1, j+ry1, i+rx2, j+ry2, c.t_ ) > threshold;
+}
+template<typename I>
+static void fastResponse( const TextonClassifier & c, const I & im, Image<double> & r, int x0, int y0, int x1, int y1, int s ){
+	const int rx1 = floorDiv( c.x1_, s ), ry1 = floorDiv( c.y1_, s ), rx2 = ceilDiv( c.x2_, s ), ry2 = ceilDiv( c.y2_, s );
+	double * rdata = r.data();
+	for( int j=y0; j<y1; j++ )
+		for( int i=x0; i<x1; i++, rdata++ )
+			*rdata = rectValue( im, i+rx1, j+ry1, i+rx2, j+ry2, c.t_ );
+}
+void TextonClassifier::fast_response(const TextonContext& c, const Image<float>& im, Image<double> & r, int x0, int y0, int x1, int y1) const {
+	fastResponse( *this, im, r, x0, y0, x1, y1, c.sub_sample_factor );
+}
+void TextonClassifier::fast_response(const TextonContext& c, const IntegralHistogram& im, Image<double> & r, int x0, int y0, int x1, int y1) const {
+	fastResponse( *this, im, r, x0, y0, x1, y1, c.sub_sample_factor );
+}
+TextonFilter TextonClassifier::filter() const {
+	TextonFilter f = {x1_, y1_, x2_, y2_, t_};
+	return f;
+}
+void TextonClassifier::fast_classify(const TextonContext& c, const Image<float>& im, Image<bool> & r) const {
+	fastClassify( *this, im, r, 0, 0, im.width(), im.height(), c.sub_sample_factor );
+}
+void TextonClassifier::fast_classify(const TextonContext& c, const IntegralHistogram& im, Image<bool> & r) const {
+	fastClassify( *this, im, r, 0, 0, im.width(), im.height(), c.sub_sample_factor );
+}
+void TextonClassifier::fast_classify(const TextonContext& c, const Image<float>& im, Image<bool> & r, int x0, int y0, int x1, int y1) const {
+	fastClassify( *this, im, r, x0, y0, x1, y1, c.sub_sample_factor );
+}
+void TextonClassifier::fast_classify(const TextonContext& c, const IntegralHistogram& im, Image<bool> & r, int x0, int y0, int x1, int y1) const {
+	fastClassify( *this, im, r, x0, y0, x1, y1, c.sub_sample_factor );
+}
+bool TextonClassifier::classify(const TextonContext& c, const Image<float>& im, int x, int y) const {
+	const int s = c.sub_sample_factor;
+	if (s > 1)
+		return rectValue( im, x+floorDiv(x1_,s), y+floorDiv(y1_,s), x+ceilDiv(x2_,s), y+ceilDiv(y2_,s), t_ ) > threshold_*(s*s);
+	return rectValue( im, x+x1_, y+y1_, x+x2_, y+y2_, t_ ) > threshold_;
+}
+bool TextonClassifier::classify(const TextonContext& c, const IntegralHistogram& im, int x, int y) const {
+	const int s = c.sub_sample_factor;
+	if (s > 1)
+		return rectValue( im, x+floorDiv(x1_,s), y+floorDiv(y1_,s), x+ceilDiv(x2_,s), y+ceilDiv(y2_,s), t_ ) > threshold_*(s*s);
+	return rectValue( im, x+x1_, y+y1_, x+x2_, y+y2_, t_ ) > threshold_;
 }
 void TextonClassifier::setThreshold(float t) {
     threshold_ = t;
 }
-void TextonClassifier::finalize() {
-    x1_ *= sub_sample_factor_;
-    x2_ *= sub_sample_factor_;
-    y1_ *= sub_sample_factor_;
-    y2_ *= sub_sample_factor_;
+void TextonClassifier::finalize(const TextonContext& c) {
+    x1_ *= c.sub_sample_factor;
+    x2_ *= c.sub_sample_factor;
+    y1_ *= c.sub_sample_factor;
+    y2_ *= c.sub_sample_factor;
 }
 QDataStream& operator<<(QDataStream& s, const TextonClassifier& c) {
     return s << c.x1_ << c.y1_ << c.x2_ << c.y2_ << c.t_ << c.threshold_;
@@ -167,11 +205,56 @@ QDataStream& operator>>(QDataStream& s, TextonClassifier& c) {
 
 
 /**** TextonBoost ****/
-Image< float > TextonBoost::integrate(const Image< short int >& texton, const QVector< int >& n_textons, int subsample) const {
+#ifdef USE_TBB
+// Count the textons of a range of rows and integrate each row
+class TBBIntegrateRows{
+	const Image< short > & texton;
+	const QVector< int > & offset;
+	Image< float > & r;
+	int subsample;
+public:
+	TBBIntegrateRows( const Image< short > & texton, const QVector< int > & offset, Image< float > & r, int subsample ):texton(texton),offset(offset),r(r),subsample(subsample){
+	}
+	void operator()( const tbb::blocked_range<int> & rows ) const{
+		for( int j=rows.begin(); j<rows.end(); j++ ){
+			// A subsampled row covers 'subsample' texton rows
+			for( int jj=j*subsample; jj<(j+1)*subsample && jj<texton.height(); jj++ )
+				for( int i=0; i<texton.width(); i++ )
+					for( int k=0; k<texton.depth(); k++ )
+						r( i/subsample, j, offset[k] + texton(i,jj,k) )+=1;
+			for( int i=1; i<r.width(); i++ )
+				for( int k=0; k<r.depth(); k++ )
+					r(i,j,k) += r(i-1,j,k);
+		}
+	}
+};
+// Integrate a range of columns
+class TBBIntegrateColumns{
+	Image< float > & r;
+public:
+	TBBIntegrateColumns( Image< float > & r ):r(r){
+	}
+	void operator()( const tbb::blocked_range<int> & cols ) const{
+		for( int j=1; j<r.height(); j++ )
+			for( int i=cols.begin(); i<cols.end(); i++ )
+				for( int k=0; k<r.depth(); k++ )
+					r(i,j,k) += r(i,j-1,k);
+	}
+};
+#endif
+Image< float > TextonBoost::integrate(const Image< short int >& texton, const QVector< int >& n_textons, int subsample, bool parallel) const {
 	int nw = (texton.width()-1)/subsample + 1;
 	int nh = (texton.height()-1)/subsample + 1;
 	Image< float > r( nw, nh, texton_offset_.last() );
 	r.fill(0);
+#ifdef USE_TBB
+	// Row prefix sums followed by column prefix sums
+	if (parallel){
+		tbb::parallel_for( tbb::blocked_range<int>(0, nh), TBBIntegrateRows( texton, texton_offset_, r, subsample ) );
+		tbb::parallel_for( tbb::blocked_range<int>(0, nw), TBBIntegrateColumns( r ) );
+		return r;
+	}
+#endif
 	// Count
 	for( int j=0; j<texton.height(); j++ )
 		for( int i=0; i<texton.width(); i++ )
@@ -188,35 +271,45 @@ Image< float > TextonBoost::integrate(const Image< short int >& texton, const QV
 	return r;
 }
 // NOTE: train will clear all textons (so save memory)
-void TextonBoost::train( QVector< Image< short > >& textons, const QVector< LabelImage >& gt, int n_rounds, int n_classifiers, int n_thresholds, int subsample, int min_rect_size, int max_rect_size ) {
+void TextonBoost::train( QVector< Image< short > >& textons, const QVector< LabelImage >& gt, int n_rounds, int n_classifiers, int n_thresholds, int subsample, int min_rect_size, int max_rect_size, bool compact_integral, const QVector< int > & texton_counts ) {
 	texton_offset_.fill( 0, textons.first().depth()+1 );
-	for( int k=0; k<textons.count(); k++ )
-		for( int i=0; i<textons[k].width()*textons[k].height(); i++ )
-			for( int j=0; j<textons[k].depth(); j++ )
-				if ( texton_offset_[j+1] <= textons[k][i*textons[k].depth()+j] )
-					texton_offset_[j+1] = textons[k][i*textons[k].depth()+j]+1;
+	if (texton_counts.count() == textons.first().depth())
+		for( int j=0; j<texton_counts.count(); j++ )
+			texton_offset_[j+1] = texton_counts[j];
+	else
+		for( int k=0; k<textons.count(); k++ )
+			for( int i=0; i<textons[k].width()*textons[k].height(); i++ )
+				for( int j=0; j<textons[k].depth(); j++ )
+					if ( texton_offset_[j+1] <= textons[k][i*textons[k].depth()+j] )
+						texton_offset_[j+1] = textons[k][i*textons[k].depth()+j]+1;
 	for( int i=1; i<texton_offset_.size(); i++ )
 		texton_offset_[i] += texton_offset_[i-1];
 
 	// Setup the weak classifier
-	TextonClassifier::sub_sample_factor_ = subsample;
-	TextonClassifier::texton_offset_ = texton_offset_;
-	TextonClassifier::min_rect_size_ = min_rect_size / subsample;
-	TextonClassifier::max_rect_size_ = max_rect_size / subsample;
+	TextonContext context( subsample );
+	context.texton_offset = texton_offset_;
+	context.min_rect_size = min_rect_size / subsample;
+	context.max_rect_size = max_rect_size / subsample;
 	
 	// Compute the subsampled integral images
 	QVector< Image<float> > int_images;
+	QVector< IntegralHistogram > int_hists;
 	for( int i=0; i<textons.count(); i++ ){
-		int_images.append( integrate( textons[i], texton_offset_, subsample ) );
+		if (compact_integral)
+			int_hists.append( IntegralHistogram( textons[i], texton_offset_, subsample ) );
+		else
+			int_images.append( integrate( textons[i], texton_offset_, subsample ) );
 		textons[i] = Image<short>();
 	}
 	// Create the data and groundtruth
 	int n_classes = 0;
 	QVector< TextonData > data;
 	QVector< signed char > groundtruth;
-	for( int k=0; k<int_images.count(); k++ ){
-		for( int j=0; j<int_images[k].height(); j++ )
-			for( int i=0; i<int_images[k].width(); i++ ){
+	for( int k=0; k<textons.count(); k++ ){
+		const int W = compact_integral ? int_hists[k].width()  : int_images[k].width();
+		const int H = compact_integral ? int_hists[k].height() : int_images[k].height();
+		for( int j=0; j<H; j++ )
+			for( int i=0; i<W; i++ ){
 				signed char g = gt[k](i*subsample, j*subsample);
 				for( int jj=j*subsample; g>=0 && jj<(j+1)*subsample && jj<gt[k].height(); jj++ )
 					for( int ii=i*subsample; g>=0 && ii<(i+1)*subsample && ii<gt[k].width(); ii++ )
@@ -224,7 +317,10 @@ void TextonBoost::train( QVector< Image< short > >& textons, const QVector< Labe
 							g = -1;
 				// Only count the sample if we are absolutely sure
 				if (g>=0){
-					data.append( TextonData( &int_images[k], i, j ) );
+					if (compact_integral)
+						data.append( TextonData( &int_hists[k], i, j ) );
+					else
+						data.append( TextonData( &int_images[k], i, j ) );
 					groundtruth.append( g );
 					if (g >= n_classes)
 						n_classes = g+1;
@@ -232,16 +328,338 @@ void TextonBoost::train( QVector< Image< short > >& textons, const QVector< Labe
 			}
 	}
 	
-	JointBoost<TextonClassifier>::train( data, groundtruth, n_classes, n_rounds, n_classifiers, n_thresholds );
+	JointBoost<TextonClassifier>::train( context, data, groundtruth, n_classes, n_rounds, n_classifiers, n_thresholds );
+}
+static int gcd( int a, int b ){
+	a = qAbs( a );
+	b = qAbs( b );
+	while( b ){
+		int t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+Image< float > TextonBoost::evaluate(const Image< short >& textons, const EvaluateOptions & options) const {
+	const int subsample = options.subsample > 0 ? options.subsample : trainingSubsample();
+	const TextonContext context( subsample );
+	
+	// Integrate and classify the whole image
+	const bool parallel = options.parallel != ClassifyOptions::SERIAL;
+	Image<float> r;
+	if (options.compact_integral)
+		r = classify( context, IntegralHistogram( textons, texton_offset_, subsample, parallel ), options );
+	else{
+		Image<float> integral = integrate( textons, texton_offset_, subsample, parallel );
+		r = classify( context, integral, options );
+	}
+	if (subsample > 1)
+		return upsample( r, textons, subsample, options.upsample );
+	return r;
+}
+template<typename I>
+void TextonBoost::classifyTile( const QVector< const TextonBoost * > & models, const TextonContext & context, const I & int_im, QVector< Image<float> > & r, int x0, int y0, int x1, int y1, const ClassifyOptions & options, const QVector< EarlyExit > & early_exit ){
+	for( int m=0; m<models.count(); m++ )
+		models[m]->classifyRegion( context, int_im, r[m], x0, y0, x1, y1, options, early_exit[m] );
+}
+#ifdef USE_TBB
+// Classify the row bands or tiles of a single image with all models in parallel
+template<typename I>
+class TBBClassifyModels{
+	const QVector< const TextonBoost * > & models;
+	const TextonContext & context;
+	const I & int_im;
+	QVector< Image<float> > & r;
+	const ClassifyOptions & options;
+	const QVector< TextonBoost::EarlyExit > & early_exit;
+public:
+	TBBClassifyModels( const QVector< const TextonBoost * > & models, const TextonContext & context, const I & int_im, QVector< Image<float> > & r, const ClassifyOptions & options, const QVector< TextonBoost::EarlyExit > & early_exit ):models(models),context(context),int_im(int_im),r(r),options(options),early_exit(early_exit){
+	}
+	void operator()( const tbb::blocked_range<int> & rows ) const{
+		TextonBoost::classifyTile( models, context, int_im, r, 0, rows.begin(), int_im.width(), rows.end(), options, early_exit );
+	}
+	void operator()( const tbb::blocked_range2d<int> & rng ) const{
+		TextonBoost::classifyTile( models, context, int_im, r, rng.cols().begin(), rng.rows().begin(), rng.cols().end(), rng.rows().end(), options, early_exit );
+	}
+};
+#endif
+template<typename I>
+QVector< Image<float> > TextonBoost::classifyModels( const QVector< const TextonBoost * > & models, const TextonContext & context, const I & int_im, const ClassifyOptions & options ){
+	QTime timer;
+	timer.start();
+	QVector< Image<float> > r;
+	QVector< EarlyExit > early_exit( models.count() );
+	for( int m=0; m<models.count(); m++ ){
+		r.append( Image<float>( int_im.width(), int_im.height(), models[m]->num_classes_ ) );
+		r[m].fill( 0 );
+		if (options.early_exit)
+			models[m]->earlyExit( early_exit[m], models[m]->numRounds( options ) );
+	}
+	// Run all models on a tile while it is still in the cache
+	const int tile_size = qMax( options.tile_size, 1 );
+#ifdef USE_TBB
+	if (options.parallel == ClassifyOptions::ROW_BANDS)
+		tbb::parallel_for( tbb::blocked_range<int>(0, int_im.height(), tile_size), TBBClassifyModels<I>( models, context, int_im, r, options, early_exit ) );
+	else if (options.parallel == ClassifyOptions::TILES)
+		tbb::parallel_for( tbb::blocked_range2d<int>(0, int_im.height(), tile_size, 0, int_im.width(), tile_size), TBBClassifyModels<I>( models, context, int_im, r, options, early_exit ) );
+	else
+#endif
+	for( int y=0; y<int_im.height(); y+=tile_size )
+		for( int x=0; x<int_im.width(); x+=tile_size )
+			classifyTile( models, context, int_im, r, x, y, qMin( x+tile_size, int_im.width() ), qMin( y+tile_size, int_im.height() ), options, early_exit );
+	qDebug("Classification time %d (%d models)", timer.elapsed(), models.count() );
+	for( int m=0; m<models.count(); m++ )
+		normalizeScores( r[m] );
+	return r;
+}
+QVector< Image< float > > TextonBoost::evaluateModels(const QVector< const TextonBoost* >& models, const Image< short >& textons, const EvaluateOptions& options) {
+	if (models.isEmpty())
+		return QVector< Image< float > >();
+	for( int m=1; m<models.count(); m++ )
+		if (models[m]->texton_offset_ != models[0]->texton_offset_){
+			qWarning( "Model %d uses different texton channels than model 0", m );
+			return QVector< Image< float > >();
+		}
+	int subsample = options.subsample;
+	if (subsample <= 0){
+		subsample = 0;
+		for( int m=0; m<models.count(); m++ )
+			subsample = gcd( subsample, models[m]->trainingSubsample() );
+	}
+	const TextonContext context( subsample );
+	const QVector< int > & texton_offset = models[0]->texton_offset_;
+	
+	// Integrate once and classify with all models
+	const bool parallel = options.parallel != ClassifyOptions::SERIAL;
+	QVector< Image<float> > r;
+	if (options.compact_integral)
+		r = classifyModels( models, context, IntegralHistogram( textons, texton_offset, subsample, parallel ), options );
+	else{
+		Image<float> integral = models[0]->integrate( textons, texton_offset, subsample, parallel );
+		r = classifyModels( models, context, integral, options );
+	}
+	if (subsample > 1)
+		for( int m=0; m<r.count(); m++ )
+			r[m] = upsample( r[m], textons, subsample, options.upsample );
+	return r;
+}
+int TextonBoost::numChannels() const {
+	return texton_offset_.count()-1;
+}
+int TextonBoost::trainingSubsample() const {
+	// finalize scaled all rectangles by the subsample factor
+	int r = 0;
+	for( int k=0; k<num_rounds_ && r!=1; k++ ){
+		const TextonClassifier & c = weak_learner_[k];
+		r = gcd( gcd( gcd( gcd( r, c.x1_ ), c.y1_ ), c.x2_ ), c.y2_ );
+	}
+	return r > 0 ? r : 1;
+}
+Image< float > TextonBoost::upsample(const Image< float >& r, const Image< short >& textons, int subsample, EvaluateOptions::Upsample mode) {
+	const int W = textons.width(), H = textons.height(), D = r.depth();
+	Image<float> res( W, H, D );
+	// Grid point (i,j) is the center of the pixels [i*s,(i+1)*s)x[j*s,(j+1)*s)
+	const float center = 0.5f*(subsample-1);
+	for( int y=0; y<H; y++ ){
+		float fy = qBound( 0.f, (y-center) / subsample, r.height()-1.f );
+		int y0 = qMin( (int)fy, qMax( r.height()-2, 0 ) ), y1 = qMin( y0+1, r.height()-1 );
+		fy -= y0;
+		for( int x=0; x<W; x++ ){
+			float fx = qBound( 0.f, (x-center) / subsample, r.width()-1.f );
+			int x0 = qMin( (int)fx, qMax( r.width()-2, 0 ) ), x1 = qMin( x0+1, r.width()-1 );
+			fx -= x0;
+			
+			const int gx[4] = {x0, x1, x0, x1}, gy[4] = {y0, y0, y1, y1};
+			float w[4] = {(1-fx)*(1-fy), fx*(1-fy), (1-fx)*fy, fx*fy};
+			if (mode == EvaluateOptions::EDGE_AWARE){
+				// Halve the weight for every texton channel that differs
+				// between the pixel and the center of the grid cell
+				float sw = 0;
+				for( int n=0; n<4; n++ ){
+					int cx = qMin( (int)(gx[n]*subsample+center), W-1 ), cy = qMin( (int)(gy[n]*subsample+center), H-1 );
+					for( int k=0; k<textons.depth(); k++ )
+						if (textons(x,y,k) != textons(cx,cy,k))
+							w[n] *= 0.5f;
+					sw += w[n];
+				}
+				for( int n=0; n<4; n++ )
+					w[n] /= sw;
+			}
+			for( int c=0; c<D; c++ ){
+				float v = 0;
+				for( int n=0; n<4; n++ )
+					v += w[n] * r(gx[n],gy[n],c);
+				res(x,y,c) = v;
+			}
+		}
+	}
+	return res;
+}
+// Order rounds by rect, texton, sharing set and threshold
+class RoundLess{
+	const QVector< TextonClassifier > & w;
+	const QVector< unsigned long long > & sset;
+public:
+	RoundLess( const QVector< TextonClassifier > & w, const QVector< unsigned long long > & sset ):w(w),sset(sset){
+	}
+	bool operator()( int i, int j ) const{
+		const TextonClassifier & a = w[i], & b = w[j];
+		if (a.x1_ != b.x1_) return a.x1_ < b.x1_;
+		if (a.y1_ != b.y1_) return a.y1_ < b.y1_;
+		if (a.x2_ != b.x2_) return a.x2_ < b.x2_;
+		if (a.y2_ != b.y2_) return a.y2_ < b.y2_;
+		if (a.t_ != b.t_) return a.t_ < b.t_;
+		if (sset[i] != sset[j]) return sset[i] < sset[j];
+		return a.threshold_ < b.threshold_;
+	}
+	bool sameBox( int i, int j ) const{
+		const TextonClassifier & a = w[i], & b = w[j];
+		return a.x1_ == b.x1_ && a.y1_ == b.y1_ && a.x2_ == b.x2_ && a.y2_ == b.y2_ && a.t_ == b.t_ && sset[i] == sset[j];
+	}
+};
+int TextonBoost::mergeSimilarRounds(float max_distance) {
+	QVector< int > order( num_rounds_ );
+	for( int k=0; k<num_rounds_; k++ )
+		order[k] = k;
+	RoundLess less( weak_learner_, sharing_set_ );
+	qSort( order.begin(), order.end(), less );
+	
+	// Find the runs of similar rounds, every round of a run is merged into
+	// the round of the run with the smallest index
+	QVector< int > merge_into( num_rounds_, -1 );
+	for( int first=0, last; first<num_rounds_; first=last ){
+		const int i = order[first];
+		int head = i;
+		for( last=first+1; last<num_rounds_; last++ ){
+			const int j = order[last];
+			if (!sharing_set_[j] || !less.sameBox( i, j ) || weak_learner_[j].threshold_ - weak_learner_[i].threshold_ > max_distance)
+				break;
+			head = qMin( head, j );
+		}
+		for( int n=first; n<last; n++ )
+			if (order[n] != head)
+				merge_into[ order[n] ] = head;
+	}
+	// Merge from the back, so that the indices stay valid
+	int n_merged = 0;
+	for( int j=num_rounds_-1; j>=0; j-- )
+		if (merge_into[j] >= 0){
+			const int i = merge_into[j];
+			// Use the threshold weighted by the response
+			float wi = fabs( a_[i] ), wj = fabs( a_[j] );
+			if (wi + wj > 0)
+				weak_learner_[i].threshold_ = (wi*weak_learner_[i].threshold_ + wj*weak_learner_[j].threshold_) / (wi + wj);
+			mergeRounds( i, j );
+			n_merged++;
+		}
+	groupFilters();
+	return n_merged;
 }
-Image< float > TextonBoost::evaluate(const Image< short >& textons) const {
-	TextonClassifier::sub_sample_factor_ = 1;
+// Sort rounds by |v|
+class AbsLess{
+	const QVector< double > & v;
+public:
+	AbsLess( const QVector< double > & v ):v(v){
+	}
+	bool operator()( int i, int j ) const{
+		return fabs( v[i] ) < fabs( v[j] );
+	}
+};
+int TextonBoost::pruneRounds(const QVector< Image< short > >& textons, double tolerance, int stride, bool mean_change) {
+	const TextonContext context;
+	if (stride < 1)
+		stride = 1;
 	
-	// Integrate
-	Image<float> integral = integrate( textons, texton_offset_, TextonClassifier::sub_sample_factor_ );
+	// Count on how many validation pixels every round fires, one image at a time
+	QVector< long long > n_fires( num_rounds_, 0 );
+	long long n_pixels = 0;
+	for( int i=0; i<textons.count(); i++ ){
+		IntegralHistogram int_hist( textons[i], texton_offset_, 1 );
+		n_pixels += (long long)((int_hist.width()+stride-1)/stride) * ((int_hist.height()+stride-1)/stride);
+		for( int k=0; k<num_rounds_; k++ ){
+			if (!sharing_set_[k])
+				continue;
+			long long n = 0;
+			for( int y=stride/2; y-stride/2<int_hist.height(); y+=stride )
+				for( int x=stride/2; x-stride/2<int_hist.width(); x+=stride )
+					n += weak_learner_[k].classify( context, int_hist, qMin( x, int_hist.width()-1 ), qMin( y, int_hist.height()-1 ) );
+			n_fires[k] += n;
+		}
+	}
+	if (!n_pixels)
+		return 0;
+	
+	// The constant part of a dropped round is kept (see removeRounds), so
+	// dropping round k changes the score of a shared class by a on the pixels
+	// it fires on. The change of any pixel is at most the sum of |a| of the
+	// dropped rounds that fire at all, the mean absolute change at most the
+	// sum of |a| times the fraction of pixels they fire on.
+	QVector< double > impact( num_rounds_, 0.0 );
+	QVector< int > order;
+	for( int k=0; k<num_rounds_; k++ )
+		if (sharing_set_[k]){
+			if (mean_change)
+				impact[k] = fabs( a_[k] ) * n_fires[k] / n_pixels;
+			else
+				impact[k] = n_fires[k] ? fabs( a_[k] ) : 0.0;
+			order.append( k );
+		}
+	qSort( order.begin(), order.end(), AbsLess( impact ) );
+	
+	// Drop the rounds with the smallest impact first, as long as the bound of
+	// every class stays within tolerance
+	QVector< double > change( num_classes_, 0.0 );
+	QVector< bool > drop( num_rounds_, false );
+	int n_dropped = 0;
+	for( int n=0; n<order.count(); n++ ){
+		const int k = order[n];
+		bool ok = true;
+		for( int c=0; c<num_classes_ && ok; c++ )
+			if (((1ll<<c)&sharing_set_[k]) && change[c] + impact[k] > tolerance)
+				ok = false;
+		if (!ok)
+			continue;
+		for( int c=0; c<num_classes_; c++ )
+			if ((1ll<<c)&sharing_set_[k])
+				change[c] += impact[k];
+		drop[k] = true;
+		n_dropped++;
+	}
+	removeRounds( drop );
+	return n_dropped;
+}
+void TextonBoost::profileRounds(const Image< short >& textons, const LabelImage& gt, int step, QVector< QVector< long long > >& correct, QVector< QVector< long long > >& total) const {
+	const TextonContext context;
+	IntegralHistogram int_hist( textons, texton_offset_, 1 );
+	const int W = int_hist.width(), H = int_hist.height();
+	const int n_checkpoints = (num_rounds_+step-1) / step;
+	if (correct.count() < n_checkpoints){
+		correct.resize( n_checkpoints );
+		total.resize( n_checkpoints );
+	}
 	
-	// Classify the whole image
-	return classify( integral );
+	// Keep the raw scores and add step rounds at a time
+	Image<float> r( W, H, num_classes_ );
+	r.fill( 0 );
+	for( int n=0; n<n_checkpoints; n++ ){
+		classifyRounds( context, int_hist, r, 0, 0, W, H, n*step, qMin( (n+1)*step, num_rounds_ ) );
+		if (correct[n].count() < num_classes_){
+			correct[n].fill( 0, num_classes_ );
+			total[n].fill( 0, num_classes_ );
+		}
+		for( int j=0; j<H; j++ )
+			for( int i=0; i<W; i++ ){
+				const int g = gt(i,j);
+				if (g < 0 || g >= num_classes_)
+					continue;
+				int l = 0;
+				for( int c=1; c<num_classes_; c++ )
+					if (r(i,j,c) > r(i,j,l))
+						l = c;
+				total[n][g]++;
+				correct[n][g] += (l == g);
+			}
+	}
 }
 QDataStream& operator<<(QDataStream& s, const TextonBoost& b) {
     s << b.texton_offset_;
@@ -28,56 +28,167 @@
 #pragma once
 
 #include "algorithm/jointboost.h"
+#include "integralhistogram.h"
+
+// Mean count of texton t in the rect [x1,x2)x[y1,y2) clipped to the image
+template<typename I>
+inline double rectValue( const I & int_image, int x1, int y1, int x2, int y2, int t ){
+	if (x1 >= int_image.width() || x2 <= 0 || y1 >= int_image.height() || y2 <= 0)
+		return 0;
+	
+	// Make the coords fit
+	if (x1 < 0) x1 = 0;
+	if (y1 < 0) y1 = 0;
+	if (x2 > int_image.width() ) x2 = int_image.width();
+	if (y2 > int_image.height()) y2 = int_image.height();
+	
+	// Sum up the rect
+	double r = int_image(x2-1,y2-1,t);
+	if (x1>0)         r -= int_image(x1-1,y2-1,t);
+	if (y1>0)         r -= int_image(x2-1,y1-1,t);
+	if (x1>0 && y1>0) r += int_image(x1-1,y1-1,t);
+	return r / ((x2-x1)*(y2-y1));
+}
 
 class TextonData{
 protected:
 	friend class TextonLearner;
 	const Image< float > * int_image_;
+	const IntegralHistogram * int_hist_;
 	int x_, y_;
 public:
 	TextonData( const Image<float> * int_image = NULL, int x=0, int y=0 );
+	TextonData( const IntegralHistogram * int_hist, int x, int y );
 	double value( int x1, int y1, int x2, int y2, int t ) const;
 };
 
+// Per model settings of the weak classifiers. Every model passes its own
+// context, so several models can be trained and evaluated concurrently.
+struct TextonContext{
+	QVector< int > texton_offset;
+	// Subsample factor of the integral image
+	int sub_sample_factor;
+	// Rect sizes (in subsampled pixels) drawn by TextonClassifier::random
+	int min_rect_size, max_rect_size;
+	TextonContext( int sub_sample_factor=1 ):texton_offset( QVector< int >()<<400 ),sub_sample_factor(sub_sample_factor),min_rect_size(5),max_rect_size(100){
+	}
+};
+
+// Rect and texton of a TextonClassifier, the key of grouping rounds by filter
+struct TextonFilter{
+	int x1, y1, x2, y2, t;
+	bool operator==( const TextonFilter & o ) const{
+		return x1 == o.x1 && y1 == o.y1 && x2 == o.x2 && y2 == o.y2 && t == o.t;
+	}
+};
+inline uint qHash( const TextonFilter & f ){
+	return (((f.x1*31 + f.y1)*31 + f.x2)*31 + f.y2)*31 + f.t;
+}
+
 class TextonClassifier{
 public:
 	friend QDataStream& operator<<( QDataStream & s, const TextonClassifier & c );
 	friend QDataStream& operator>>( QDataStream & s, TextonClassifier & c );
+	typedef TextonContext Context;
+	typedef TextonFilter Filter;
 	int x1_, y1_, x2_, y2_;
 	int t_;
 	float threshold_;
-protected: // Static settings
-	friend class TextonBoost;
-	static QVector< int > texton_offset_;
-	static int sub_sample_factor_;
-	static int min_rect_size_;
-	static int max_rect_size_;
-public:
-	static TextonClassifier random();
-	double value( const TextonData & data ) const;
-	Image<float> value(const Image<float>& im) const;
-	bool classify( const TextonData & data ) const;
-	Image<bool> classify( const Image<float> & im ) const;
-	void fast_classify( const Image<float> & im, Image<bool> & res ) const;
+	static TextonClassifier random( const TextonContext & c );
+	double value( const TextonContext & c, const TextonData & data ) const;
+	Image<float> value( const TextonContext & c, const Image<float>& im ) const;
+	bool classify( const TextonContext & c, const TextonData & data ) const;
+	Image<bool> classify( const TextonContext & c, const Image<float> & im ) const;
+	void fast_classify( const TextonContext & c, const Image<float> & im, Image<bool> & res ) const;
+	void fast_classify( const TextonContext & c, const IntegralHistogram & im, Image<bool> & res ) const;
+	// Classify the pixels [x0,x1)x[y0,y1) only, res has the size of the region
+	void fast_classify( const TextonContext & c, const Image<float> & im, Image<bool> & res, int x0, int y0, int x1, int y1 ) const;
+	void fast_classify( const TextonContext & c, const IntegralHistogram & im, Image<bool> & res, int x0, int y0, int x1, int y1 ) const;
+	bool classify( const TextonContext & c, const Image<float> & im, int x, int y ) const;
+	bool classify( const TextonContext & c, const IntegralHistogram & im, int x, int y ) const;
+	// Rect and texton, classifiers with the same filter only differ in their threshold
+	Filter filter() const;
+	// Box response of the pixels [x0,x1)x[y0,y1) and it's threshold
+	void fast_response( const TextonContext & c, const Image<float> & im, Image<double> & res, int x0, int y0, int x1, int y1 ) const;
+	void fast_response( const TextonContext & c, const IntegralHistogram & im, Image<double> & res, int x0, int y0, int x1, int y1 ) const;
+	bool classifyResponse( const TextonContext & c, double response ) const{
+		return response > threshold_*(c.sub_sample_factor*c.sub_sample_factor);
+	}
 	void setThreshold( float t );
-	void finalize();
+	void finalize( const TextonContext & c );
 };
 QDataStream& operator<<( QDataStream & s, const TextonClassifier & c );
 QDataStream& operator>>( QDataStream & s, TextonClassifier & c );
 
 
+// Settings for TextonBoost::evaluate
+struct EvaluateOptions: public ClassifyOptions{
+	// Use an IntegralHistogram instead of a float integral image
+	bool compact_integral;
+	// Only evaluate every subsample'th pixel (1 = full resolution, 0 = use
+	// the subsample factor of the training)
+	int subsample;
+	// How to bring the subsampled scores back to full resolution
+	enum Upsample{
+		BILINEAR,
+		// Bilinear, but down weight grid points with different textons
+		EDGE_AWARE
+	};
+	Upsample upsample;
+	EvaluateOptions():compact_integral(false),subsample(1),upsample(BILINEAR){
+	}
+};
+
 class LabelImage;
 class TextonBoost: protected JointBoost<TextonClassifier>
 {
 protected:
 	friend QDataStream& operator<<( QDataStream & s, const TextonBoost & b );
 	friend QDataStream& operator>>( QDataStream & s, TextonBoost & b );
+	friend class QuantizedTextonBoost;
+	friend class FlatTextonBoost;
 	QVector< int > texton_offset_;
-	Image<float> integrate( const Image< short int >& texton, const QVector< int >& n_textons, int subsample ) const;
+	Image<float> integrate( const Image< short int >& texton, const QVector< int >& n_textons, int subsample, bool parallel=false ) const;
+	static Image<float> upsample( const Image<float> & r, const Image< short >& textons, int subsample, EvaluateOptions::Upsample mode );
+#ifdef USE_TBB
+	template<typename I> friend class TBBClassifyModels;
+#endif
+	// Classify the pixels [x0,x1)x[y0,y1) with all models, one after the other
+template<typename I>
+	static void classifyTile( const QVector< const TextonBoost * > & models, const TextonContext & context, const I & int_im, QVector< Image<float> > & r, int x0, int y0, int x1, int y1, const ClassifyOptions & options, const QVector< EarlyExit > & early_exit );
+template<typename I>
+	static QVector< Image<float> > classifyModels( const QVector< const TextonBoost * > & models, const TextonContext & context, const I & int_im, const ClassifyOptions & options );
 public:
 	// train will clear all textons (so save memory)
-	void train( QVector< Image< short > >& textons, const QVector< LabelImage >& gt, int n_rounds, int n_classifiers, int n_thresholds, int subsample, int min_rect_size, int max_rect_size );
-	Image<float> evaluate( const Image< short >& textons ) const;
+	// compact_integral uses an IntegralHistogram instead of float integral images
+	// texton_counts (textons per channel, see loadTextonCounts) saves the scan
+	// over all pixels, if empty the counts are taken from the textons
+	void train( QVector< Image< short > >& textons, const QVector< LabelImage >& gt, int n_rounds, int n_classifiers, int n_thresholds, int subsample, int min_rect_size, int max_rect_size, bool compact_integral = false, const QVector< int > & texton_counts = QVector< int >() );
+	Image<float> evaluate( const Image< short >& textons, const EvaluateOptions & options = EvaluateOptions() ) const;
+	// Evaluate several models with the same texton channels on one shared
+	// integral image, the rounds of all models are interleaved per tile.
+	// Returns one score image per model (none if the models use different
+	// texton channels). A subsample of 0 uses the gcd of the training
+	// subsample factors.
+	static QVector< Image<float> > evaluateModels( const QVector< const TextonBoost * > & models, const Image< short >& textons, const EvaluateOptions & options = EvaluateOptions() );
+	// Subsample factor used in training (inferred from the rectangles)
+	int trainingSubsample() const;
+	using JointBoost<TextonClassifier>::numRounds;
+	// Number of texton channels (depth of the texton image)
+	int numChannels() const;
+	// Merge rounds with the same rect, texton and sharing set whose thresholds
+	// are at most max_distance apart, returns the number of merged rounds
+	int mergeSimilarRounds( float max_distance );
+	// Greedily drop the rounds with the smallest |a| as long as no score of
+	// the validation pixels (every stride'th pixel) can change by more than
+	// tolerance. With mean_change only the mean absolute score change of every
+	// class is bounded (and rounds are ordered by |a| times firing rate),
+	// which prunes more but may drop rare rounds that decide small objects.
+	// Returns the number of dropped rounds.
+	int pruneRounds( const QVector< Image< short > >& textons, double tolerance, int stride, bool mean_change = false );
+	// Add the number of correct and labeled pixels per class after every
+	// step rounds (and after the last round) to correct and total
+	void profileRounds( const Image< short >& textons, const LabelImage & gt, int step, QVector< QVector< long long > > & correct, QVector< QVector< long long > > & total ) const;
 	void save( const QString & s );
 	void load( const QString& name );
 };
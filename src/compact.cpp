@@ -0,0 +1,123 @@
+/*
+    Copyright (c) 2011, Philipp Krähenbühl
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+        * Neither the name of the Stanford University nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY Philipp Krähenbühl ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL Philipp Krähenbühl BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "util/labelimage.h"
+#include "util/colorimage.h"
+#include "util/util.h"
+#include "util/dataset.h"
+#include "feature/texton.h"
+#include "settings.h"
+#include <QVector>
+#include <QString>
+#include <QTime>
+#include "classifier/textonboost.h"
+
+// Evaluate all images, returns the time in ms and the number of correct pixels
+static int evaluateAll( const TextonBoost & booster, const QVector< Image<short> > & textons, const QVector< LabelImage > & labels, long long & n_correct, long long & n_labeled ){
+	EvaluateOptions options;
+	options.compact_integral = true;
+	n_correct = n_labeled = 0;
+	QTime timer;
+	int time = 0;
+	for( int i=0; i<textons.count(); i++ ){
+		timer.start();
+		Image<float> r = booster.evaluate( textons[i], options );
+		time += timer.elapsed();
+		for( int j=0; j<r.height(); j++ )
+			for( int x=0; x<r.width(); x++ ){
+				int l = 0;
+				for( int c=1; c<r.depth(); c++ )
+					if (r(x,j,c) > r(x,j,l))
+						l = c;
+				if (labels[i](x,j) >= 0){
+					n_labeled++;
+					n_correct += (labels[i](x,j) == l);
+				}
+			}
+	}
+	return time;
+}
+
+int main( int argc, char * argv[]){
+	/**** Read the IO ****/
+	QVector< QString > args;
+	double tolerance = 0.1;
+	float merge_distance = 0;
+	int stride = 0;
+	bool mean_change = false;
+	for( int i=0; i<argc; i++ ){
+		QString arg = argv[i];
+		if (arg == "--tolerance" && i+1<argc)
+			tolerance = QString( argv[++i] ).toDouble();
+		else if (arg == "--merge" && i+1<argc)
+			merge_distance = QString( argv[++i] ).toDouble();
+		else if (arg == "--stride" && i+1<argc)
+			stride = QString( argv[++i] ).toInt();
+		else if (arg == "--mean")
+			mean_change = true;
+		else
+			args.append( arg );
+	}
+	if (args.count()<4){
+		qWarning( "Usage: %s [options] classifier_file compact_file texton_file [texton_file ...]", argv[0] );
+		qWarning( "     --tolerance t: Largest score change of a validation pixel (default 0.1)" );
+		qWarning( "     --mean       : Only bound the mean score change of every class by t (prunes more," );
+		qWarning( "                    but may drop rare rounds that decide small objects)" );
+		qWarning( "     --merge d    : Merge rounds on the same box with thresholds d apart (default 0)" );
+		qWarning( "     --stride s   : Only use every s'th validation pixel (default: training subsample)" );
+		return 1;
+	}
+	QVector< QString > texton_files = args.mid( 3 );
+	
+	TextonBoost booster;
+	booster.load( args[1] );
+	TextonBoost original = booster;
+	const int n_rounds = booster.numRounds();
+	
+	/**** Compact the model ****/
+	qDebug("(compact) Loading the validation set");
+	QVector< Image<short> > textons = loadTextonChannels( texton_files, Dataset( VALID ).names() );
+	
+	int n_merged = booster.mergeSimilarRounds( merge_distance );
+	int n_pruned = booster.pruneRounds( textons, tolerance, stride > 0 ? stride : booster.trainingSubsample(), mean_change );
+	booster.save( args[2] );
+	textons.clear();
+	
+	/**** Report ****/
+	qDebug("(compact) Loading the test set");
+	Dataset test( TEST, Dataset::LABELS );
+	QVector< LabelImage > labels = test.labels();
+	textons = loadTextonChannels( texton_files, test.names() );
+	
+	long long correct_before, correct_after, n_labeled;
+	int time_before = evaluateAll( original, textons, labels, correct_before, n_labeled );
+	int time_after = evaluateAll( booster, textons, labels, correct_after, n_labeled );
+	qDebug( "Rounds     %d -> %d (%d merged, %d pruned)", n_rounds, booster.numRounds(), n_merged, n_pruned );
+	qDebug( "Time       %d ms -> %d ms (speed-up %0.2f)", time_before, time_after, (double)time_before / qMax( time_after, 1 ) );
+	qDebug( "Accuracy   %0.4f%% -> %0.4f%%", 100.0*correct_before / qMax( n_labeled, 1ll ), 100.0*correct_after / qMax( n_labeled, 1ll ) );
+	return 0;
+}
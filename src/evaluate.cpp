@@ -29,13 +29,18 @@
 #include "util/colorconvertion.h"
 #include "util/labelimage.h"
 #include "util/util.h"
+#include "util/dataset.h"
 #include "feature/texton.h"
 #include "settings.h"
 #include "config.h"
 #include <QVector>
 #include <QString>
 #include <QDir>
+#include <QFileInfo>
+#include <QStringList>
 #include "classifier/textonboost.h"
+#include "classifier/quantizedtextonboost.h"
+#include "classifier/flattextonboost.h"
 
 #ifdef USE_TBB
 #include <tbb/task_scheduler_init.h>
@@ -43,9 +48,7 @@
 #include <tbb/blocked_range.h>
 #endif
 
-void evaluate( const TextonBoost & booster, const Image<short> & texton, const QString & save_file ){
-	Image<float> r = booster.evaluate( texton );
-	
+void saveUnary( const Image<float> & r, const QString & save_file ){
 	// Save the result
 	QFile file( save_file );
 	if (file.open( QFile::WriteOnly ) ){
@@ -60,53 +63,162 @@ void evaluate( const TextonBoost & booster, const Image<short> & texton, const Q
 	file.close();
 	
 }
+template<typename B>
+void evaluate( const B & booster, const Image<short> & texton, const QString & save_file, const EvaluateOptions & options ){
+	saveUnary( booster.evaluate( texton, options ), save_file );
+}
+// Several models evaluated on one shared integral image, the scores of model
+// m are saved to save_dirs[m]
+struct ModelSet{
+	QVector< const TextonBoost * > models;
+	QVector< QString > save_dirs;
+};
+void evaluate( const ModelSet & set, const Image<short> & texton, const QString & save_file, const EvaluateOptions & options ){
+	QVector< Image<float> > r = TextonBoost::evaluateModels( set.models, texton, options );
+	const QString name = QFileInfo( save_file ).fileName();
+	for( int m=0; m<r.count(); m++ )
+		saveUnary( r[m], set.save_dirs[m] + "/" + name );
+}
 
 #ifdef USE_TBB
+template<typename B>
 class TBBEvaluate{
-	const TextonBoost & booster;
+	const B & booster;
 	const QVector< Image<short> > & textons;
 	const QVector<QString> & names;
 	const QString & save_dir;
+	const EvaluateOptions & options;
 public:
-	TBBEvaluate( const TextonBoost & booster, const QVector< Image<short> > & textons, const QVector<QString> & names, const QString & save_dir ):booster(booster), textons(textons), names(names), save_dir(save_dir){}
+	TBBEvaluate( const B & booster, const QVector< Image<short> > & textons, const QVector<QString> & names, const QString & save_dir, const EvaluateOptions & options ):booster(booster), textons(textons), names(names), save_dir(save_dir), options(options){}
 	void operator()( tbb::blocked_range<int> rng ) const{
 		for( int i=rng.begin(); i<rng.end(); i++ ){
 			qDebug("Doing Image %d", i );
-			evaluate( booster, textons[i], save_dir + "/" + names[i] + ".unary" );
+			evaluate( booster, textons[i], save_dir + "/" + names[i] + ".unary", options );
 		}
 	}
 };
-void evaluate_all( const TextonBoost & booster, const QVector< Image<short> > & textons, const QVector<QString> & names, const QString & save_dir ){
-	tbb::parallel_for(tbb::blocked_range<int>(0, textons.size(), 1), TBBEvaluate(booster, textons, names, save_dir));
+template<typename B>
+void evaluate_all( const B & booster, const QVector< Image<short> > & textons, const QVector<QString> & names, const QString & save_dir, const EvaluateOptions & options ){
+	tbb::parallel_for(tbb::blocked_range<int>(0, textons.size(), 1), TBBEvaluate<B>(booster, textons, names, save_dir, options));
 }
 #else
-void evaluate_all( const TextonBoost & booster, const QVector< Image<short> > & textons, const QVector<QString> & names, const QString & save_dir ){
+template<typename B>
+void evaluate_all( const B & booster, const QVector< Image<short> > & textons, const QVector<QString> & names, const QString & save_dir, const EvaluateOptions & options ){
 	for( int i=0; i<textons.count(); i++ ){
 		qDebug("Doing Image %d", i );
-		evaluate( booster, textons[i], save_dir + "/" + names[i] + ".unary" );
+		evaluate( booster, textons[i], save_dir + "/" + names[i] + ".unary", options );
 	}
 }
 #endif
 int main( int argc, char * argv[]){
 	/**** Read the IO ****/
-	if (argc<4){
-		qWarning( "Usage: %s classifier_file texton_file save_dir", argv[0] );
+	QVector< QString > args;
+	EvaluateOptions options;
+	bool quantized = false, flat = false, models = false;
+	for( int i=0; i<argc; i++ ){
+		QString arg = argv[i];
+		if (arg == "--compact")
+			options.compact_integral = true;
+		else if (arg == "--quantized")
+			quantized = true;
+		else if (arg == "--flat")
+			flat = true;
+		else if (arg == "--models")
+			models = true;
+		else if (arg == "--early-exit")
+			options.early_exit = true;
+		else if (arg == "--budget" && i+1<argc){
+			options.early_exit = true;
+			options.time_budget = QString( argv[++i] ).toInt();
+		}
+		else if (arg == "--parallel" && i+1<argc){
+			QString mode = argv[++i];
+			if (mode == "bands")
+				options.parallel = ClassifyOptions::ROW_BANDS;
+			else if (mode == "tiles")
+				options.parallel = ClassifyOptions::TILES;
+			else
+				qFatal( "Unknown parallel mode '%s'", qPrintable( mode ) );
+		}
+		else if (arg == "--rounds" && i+1<argc)
+			options.max_rounds = QString( argv[++i] ).toInt();
+		else if (arg == "--subsample" && i+1<argc)
+			options.subsample = QString( argv[++i] ).toInt();
+		else if (arg == "--upsample" && i+1<argc){
+			QString mode = argv[++i];
+			if (mode == "bilinear")
+				options.upsample = EvaluateOptions::BILINEAR;
+			else if (mode == "edge")
+				options.upsample = EvaluateOptions::EDGE_AWARE;
+			else
+				qFatal( "Unknown upsample mode '%s'", qPrintable( mode ) );
+		}
+		else
+			args.append( arg );
+	}
+	if (args.count()<4){
+		qWarning( "Usage: %s [options] classifier_file texton_file save_dir", argv[0] );
+		qWarning( "     --compact    : Use a 16 bit integral histogram (less memory)" );
+		qWarning( "     --quantized  : classifier_file is a quantized model (see quantize)" );
+		qWarning( "     --flat       : classifier_file is a flat model (see flatten)" );
+		qWarning( "     --models     : classifier_file is a comma separated list of models, all" );
+		qWarning( "                    evaluated on one integral image (saved to save_dir/<model>)" );
+		qWarning( "     --early-exit : Stop tiles once the labels of all their pixels are decided" );
+		qWarning( "     --budget ms  : Stop the early exit classification after ms milliseconds" );
+		qWarning( "     --parallel m : Parallelize within each image (m = bands or tiles)" );
+		qWarning( "     --rounds n   : Only use the first n boosting rounds" );
+		qWarning( "     --subsample s: Only evaluate every s'th pixel (0 = training subsample)" );
+		qWarning( "     --upsample m : Upsample the subsampled scores (m = bilinear or edge)" );
 		return 1;
 	}
-	QString boost_file = argv[1];
-	QString save_dir = argv[argc-1];
+	// The quantized and flat models only evaluate all pixels at full
+	// resolution (with an IntegralHistogram)
+	if (quantized || flat){
+		const char * model = quantized ? "--quantized" : "--flat";
+		if (options.subsample != 1 || options.upsample != EvaluateOptions::BILINEAR){
+			qWarning( "--subsample and --upsample are not supported with %s", model );
+			return 1;
+		}
+		if (options.early_exit){
+			qWarning( "--early-exit and --budget are not supported with %s", model );
+			return 1;
+		}
+		if (quantized && options.parallel != ClassifyOptions::SERIAL)
+			qWarning( "--parallel is ignored with --quantized" );
+		if (models){
+			qWarning( "--models is not supported with %s", model );
+			return 1;
+		}
+	}
+	QString boost_file = args[1];
+	QString save_dir = args.last();
 	
-	// Declare all variables we need for both training and evaluation
-	QVector< ColorImage > images;
-	QVector< LabelImage > labels;
-	QVector< Image<short> > textons;
-	QVector< QString > names;
+	// Load all models once, they have to use the same texton channels
+	QVector< TextonBoost > boosters;
+	ModelSet model_set;
+	if (models){
+		const QStringList files = boost_file.split( ',', QString::SkipEmptyParts );
+		boosters.resize( files.count() );
+		for( int m=0; m<files.count(); m++ ){
+			boosters[m].load( files[m] );
+			if (boosters[m].numChannels() != boosters[0].numChannels()){
+				qWarning( "'%s' uses different texton channels than '%s'", qPrintable( files[m] ), qPrintable( files[0] ) );
+				return 1;
+			}
+			const QString dir = save_dir + "/" + QFileInfo( files[m] ).baseName();
+			if (model_set.save_dirs.contains( dir )){
+				qWarning( "Two models are saved to '%s'", qPrintable( dir ) );
+				return 1;
+			}
+			QDir().mkpath( dir );
+			model_set.save_dirs.append( dir );
+		}
+		for( int m=0; m<boosters.count(); m++ )
+			model_set.models.append( &boosters[m] );
+	}
 	
-	/**** Training ****/
-	qDebug("(test) Loading the database");
-	loadImages( images, labels, names, ALL );
-	images.clear();
-	labels.clear();
+	// Only the names are needed, nothing is decoded
+	const QVector< QString > names = Dataset( ALL ).names();
 	
 	// Saving memory [not having vwrender crash]
 	for( int n=0; n<names.count(); n+=100 ){
@@ -116,29 +228,33 @@ int main( int argc, char * argv[]){
 		
 		
 		qDebug("(test) Loading textons");
-		int nTextons = argc-3;
-		QVector< Image<short> > textons;
-		for( int i=2; i<argc-1; i++ ){
-			QVector< Image<short> > tmp = loadTextons( argv[i], cur_names );
-			for( int j=0; j<tmp.size(); j++ ){
-				if (j >= textons.count())
-					textons.append( Image<short>(tmp[j].width(), tmp[j].height(), nTextons) );
-				for( int k=0; k<tmp[j].width()*tmp[j].height(); k++ )
-					textons[j][k*nTextons+i-2] = tmp[j][k];
-			}
-		}
+		QVector< Image<short> > textons = loadTextonChannels( args.mid( 2, args.count()-3 ), cur_names );
 		
 		// Training
 		qDebug("(test) Evaluating");
-		TextonBoost booster;
-		booster.load( boost_file );
-		
 		// Create the output directory
 		QDir dir( save_dir );
 		if (!dir.exists())
 			dir.mkpath( dir.absolutePath() );
 		
 		// Do the hard work
-		evaluate_all( booster, textons, cur_names, save_dir );
+		if (models)
+			evaluate_all( model_set, textons, cur_names, save_dir, options );
+		else if (flat){
+			FlatTextonBoost booster;
+			if (!booster.load( boost_file ))
+				return 1;
+			evaluate_all( booster, textons, cur_names, save_dir, options );
+		}
+		else if (quantized){
+			QuantizedTextonBoost booster;
+			booster.load( boost_file );
+			evaluate_all( booster, textons, cur_names, save_dir, options );
+		}
+		else{
+			TextonBoost booster;
+			booster.load( boost_file );
+			evaluate_all( booster, textons, cur_names, save_dir, options );
+		}
 	}
 }
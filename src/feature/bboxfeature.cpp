@@ -37,6 +37,11 @@ int BBoxFeature::size() const
 	return 20;
 }
 
+QString BBoxFeature::spec() const
+{
+	return "bbox";
+}
+
 Image< float > BBoxFeature::evaluate(const Image< float > lab_image, const QString& image_name)
 {
 	Image< float > r(lab_image.width(), lab_image.height(), size() );
@@ -35,6 +35,7 @@ class BBoxFeature : public Feature
 
 public:
     virtual int size() const;
+    virtual QString spec() const;
     virtual Image< float > evaluate(const Image< float > lab_image, const QString& image_name);
 };
 
@@ -27,9 +27,13 @@
 
 #include "colorfeature.h"
 #include "util/image.h"
+#include <QString>
 int ColorFeature::size() const {
     return 3;
 }
+QString ColorFeature::spec() const {
+	return "color";
+}
 Image< float > ColorFeature::evaluate(const Image< float > lab_image, const QString& name) {
 	return lab_image;
 }
@@ -32,4 +32,5 @@ class ColorFeature: public Feature
 public:
 	virtual Image<float> evaluate( const Image<float> lab_image, const QString & name );
 	virtual int size() const;
+	virtual QString spec() const;
 };
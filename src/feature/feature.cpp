@@ -26,4 +26,35 @@
 */
 
 #include "feature.h"
+#include "filterbank.h"
+#include "colorfeature.h"
+#include "hogfeature.h"
+#include "locationfeature.h"
+#include "bboxfeature.h"
+#include <settings.h>
+#include <QSharedPointer>
+#include <QStringList>
+
+QSharedPointer<Feature> createFeature( const QString & spec ){
+	QStringList parts = spec.toLower().split( ':' );
+	const QString type = parts.first();
+	const QString param = parts.count() > 1 ? parts[1] : QString();
+	if (type == "filterbank"){
+		const int filters = parts.count() > 2 ? parts[2].toInt() : (int)FilterBank::ALL;
+		return QSharedPointer<Feature>( new FilterBank( param.isEmpty() ? FILTER_BANK_SIZE : param.toFloat(), filters ) );
+	}
+	if (type == "color")
+		return QSharedPointer<Feature>( new ColorFeature() );
+	if (type == "location")
+		return QSharedPointer<Feature>( new LocationFeature() );
+	if (type == "hog"){
+		HogFeature::HogFeatureType hog_type = HogFeature::L;
+		if (param == "a") hog_type = HogFeature::A;
+		if (param == "b") hog_type = HogFeature::B;
+		return QSharedPointer<Feature>( new HogFeature( hog_type ) );
+	}
+	if (type == "bbox")
+		return QSharedPointer<Feature>( new BBoxFeature() );
+	return QSharedPointer<Feature>();
+}
 
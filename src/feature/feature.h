@@ -30,10 +30,18 @@
 class QString;
 template<class T >
 class Image;
+template<class T >
+class QSharedPointer;
 
 class Feature
 {
 public:
 	virtual Image<float> evaluate( const Image<float> lab_image, const QString & image_name ) = 0;
 	virtual int size() const = 0;
+	// Spec that recreates this feature with createFeature
+	virtual QString spec() const = 0;
 };
+
+// Create a feature from a spec "type[:param]" (filterbank[:size[:filters]],
+// color, hog[:l|a|b], location or bbox), returns NULL for unknown types
+QSharedPointer<Feature> createFeature( const QString & spec );
@@ -28,6 +28,7 @@
 #include "filterbank.h"
 #include "util/image.h"
 #include <QVector>
+#include <QString>
 #include <cmath>
 
 #define PI 3.14159265358979323846
@@ -136,7 +137,7 @@ static void setChannel( Image<float> & r, const Image<float> & image, int c ){
 			r(i,j,c) = image(i,j);
 }
 
-FilterBank::FilterBank(float kappa, int filters):filters_(filters) {
+FilterBank::FilterBank(float kappa, int filters):kappa_(kappa),filters_(filters) {
 	// Create the kernels
 	g1_ = gaussianKernel( 1*kappa );
 	g2_ = gaussianKernel( 2*kappa );
@@ -187,3 +188,9 @@ Image< float > FilterBank::evaluate(const Image< float > lab_image, const QStrin
 int FilterBank::size() const {
 	return (filters_ & GAUSSIAN ? 9 : 0) + (filters_ & DGAUSSIAN ? 4 : 0) + (filters_ & LGAUSSIAN ? 4 : 0);
 }
+QString FilterBank::spec() const {
+	QString r = "filterbank:" + QString::number( kappa_ );
+	if (filters_ != ALL)
+		r += ":" + QString::number( filters_ );
+	return r;
+}
@@ -36,6 +36,7 @@ class Image;
 
 class FilterBank: public Feature
 {
+	float kappa_;
 	int filters_;
 	QVector<float> g1_, g2_, g4_, g8_, dg2_, dg4_, lg1_, lg2_, lg4_, lg8_;
 public:
@@ -48,4 +49,5 @@ public:
 	FilterBank( float kappa = 1.0, int filters = ALL );
 	virtual Image<float> evaluate( const Image<float> lab_image, const QString & name );
 	virtual int size() const;
+	virtual QString spec() const;
 };
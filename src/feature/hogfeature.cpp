@@ -27,6 +27,7 @@
 
 #include "hogfeature.h"
 #include "util/image.h"
+#include <QString>
 #include <cmath>
 
 const int nAngleBins = 9;
@@ -38,6 +39,10 @@ int HogFeature::size() const {
 	return nAngleBins*nCells*nCells;
 }
 
+QString HogFeature::spec() const {
+	return type_ == A ? "hog:a" : (type_ == B ? "hog:b" : "hog:l");
+}
+
 Image< float > HogFeature::evaluate(const Image< float > lab_image, const QString& name) {
 	Image< float > og( lab_image.width(), lab_image.height(), nAngleBins );
 	og.fill( 0.0 );
@@ -43,5 +43,6 @@ protected:
 public:
 	HogFeature( HogFeatureType type = L );
     virtual int size() const;
+    virtual QString spec() const;
     virtual Image< float > evaluate(const Image< float > lab_image, const QString & name);
 };
@@ -27,11 +27,16 @@
 
 #include "locationfeature.h"
 #include "util/image.h"
+#include <QString>
 
 int LocationFeature::size() const {
 	return 2;
 }
 
+QString LocationFeature::spec() const {
+	return "location";
+}
+
 Image< float > LocationFeature::evaluate(const Image< float > lab_image, const QString& name) {
 	Image< float > res( lab_image.width(), lab_image.height(), 2 );
 	for( int j=0; j<res.height(); j++ )
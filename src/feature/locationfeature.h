@@ -34,5 +34,6 @@ class LocationFeature : public Feature
 
 public:
     virtual int size() const;
+    virtual QString spec() const;
     virtual Image< float > evaluate(const Image< float > lab_image, const QString & name);
 };
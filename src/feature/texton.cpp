@@ -26,19 +26,30 @@
 */
 
 #include "texton.h"
+#include "textonarchive.h"
+#include "util/colorimage.h"
+#include "util/colorconvertion.h"
+#include "util/dataset.h"
 #include "config.h"
 #ifdef USE_TBB
 #include <tbb/task_scheduler_init.h>
 #include <tbb/parallel_for.h>
 #include <tbb/parallel_reduce.h>
 #include <tbb/blocked_range.h>
+#include <tbb/pipeline.h>
 #endif
 #include <QMap>
 #include <Eigen/SVD>
 #include <QSet>
 
+static const QString DICTIONARY_MAGIC = "TextonDictionary";
+static const int DICTIONARY_VERSION = 1;
+
 Texton::Texton( QSharedPointer<Feature> feature, int n_textons ) :feature_(feature), N_(n_textons) {
 }
+QSharedPointer<Feature> Texton::feature() const {
+	return feature_;
+}
 
 #ifdef USE_TBB
 class TBBComputeFeatures{
@@ -173,6 +184,67 @@ void Texton::train(const QVector< Image< float > >& lab_images, const QVector<QS
 	// Train the texton directory
 	kmeans_.train( features.data(), feature_size, n_features, N_ );
 }
+static QDataStream & operator<<( QDataStream & s, const MatrixXd & m ){
+	s << (int)m.rows() << (int)m.cols();
+	for( int j=0; j<m.cols(); j++ )
+		for( int i=0; i<m.rows(); i++ )
+			s << m(i,j);
+	return s;
+}
+static QDataStream & operator>>( QDataStream & s, MatrixXd & m ){
+	int rows, cols;
+	s >> rows >> cols;
+	m.resize( rows, cols );
+	for( int j=0; j<cols; j++ )
+		for( int i=0; i<rows; i++ )
+			s >> m(i,j);
+	return s;
+}
+bool Texton::save(const QString& filename) const {
+	QFile file( filename );
+	if (!file.open(QFile::WriteOnly)){
+		qWarning( "Failed to save the texton dictionary to '%s'", qPrintable( filename ) );
+		return false;
+	}
+	QDataStream s( &file );
+	s << DICTIONARY_MAGIC << DICTIONARY_VERSION << feature_->spec();
+	s << N_ << MatrixXd( mean_ ) << transformation_ << kmeans_;
+	return true;
+}
+bool Texton::load(const QString& filename) {
+	QFile file( filename );
+	if (!file.open(QFile::ReadOnly)){
+		qWarning( "Failed to load the texton dictionary '%s'", qPrintable( filename ) );
+		return false;
+	}
+	QDataStream s( &file );
+	QString magic, spec;
+	int version = 0;
+	s >> magic >> version;
+	if (magic != DICTIONARY_MAGIC || version != DICTIONARY_VERSION){
+		qWarning( "'%s' is not a texton dictionary", qPrintable( filename ) );
+		return false;
+	}
+	s >> spec;
+	QSharedPointer<Feature> feature = createFeature( spec );
+	if (feature.isNull()){
+		qWarning( "Unknown feature '%s' in '%s'", qPrintable( spec ), qPrintable( filename ) );
+		return false;
+	}
+	if (!feature_.isNull() && feature_->spec() != spec){
+		qWarning( "'%s' was trained with feature '%s', not '%s'", qPrintable( filename ), qPrintable( spec ), qPrintable( feature_->spec() ) );
+		return false;
+	}
+	MatrixXd mean;
+	s >> N_ >> mean >> transformation_ >> kmeans_;
+	if (s.status() != QDataStream::Ok || mean.cols() != 1 || feature->size() != transformation_.cols()){
+		qWarning( "'%s' is a corrupt texton dictionary", qPrintable( filename ) );
+		return false;
+	}
+	feature_ = feature;
+	mean_ = mean.col(0);
+	return true;
+}
 Image< short > Texton::textonize(const Image< float >& lab_image, const QString & name ) const{
 	Image< float > feature_response = feature_->evaluate( lab_image, name );
 	// Whitening (zero mean, 1 stddev)
@@ -214,33 +286,335 @@ QVector< Image< short > > Texton::textonize(const QVector< Image< float > >& lab
 	return r;
 }
 #endif
+#ifdef USE_TBB
+// Textonize one image with several dictionaries
+class TBBTextonizeChannels{
+	const QVector< const Texton * > & textons;
+	const Image< float > & lab;
+	const QString & name;
+	QVector< Image< short > > & r;
+public:
+	TBBTextonizeChannels( const QVector< const Texton * > & textons, const Image< float > & lab, const QString & name, QVector< Image< short > > & r ):textons(textons),lab(lab),name(name),r(r){
+	}
+	void operator()( const tbb::blocked_range<int> & rng ) const{
+		for( int k=rng.begin(); k<rng.end(); k++ )
+			r[k] = textons[k]->textonize( lab, name );
+	}
+};
+#endif
+QVector< Image< short > > textonizeChannels( const QVector< const Texton * > & textons, const ColorImage & image, const QString & name ){
+	const Image< float > lab = RGBtoLab( image );
+	QVector< Image< short > > r( textons.count() );
+#ifdef USE_TBB
+	tbb::parallel_for( tbb::blocked_range<int>(0, textons.count(), 1), TBBTextonizeChannels( textons, lab, name, r ) );
+#else
+	for( int k=0; k<textons.count(); k++ )
+		r[k] = textons[k]->textonize( lab, name );
+#endif
+	return r;
+}
+Image< short > mergeChannels( const QVector< Image< short > > & images ){
+	int D = 0;
+	foreach( const Image< short > & t, images )
+		D += t.depth();
+	const int W = images.first().width(), H = images.first().height();
+	Image< short > r( W, H, D );
+	for( int a=0, o=0; a<images.count(); o+=images[a].depth(), a++ ){
+		const Image< short > & t = images[a];
+		const int d = t.depth();
+		for( int i=0; i<W*H; i++ )
+			for( int c=0; c<d; c++ )
+				r[i*D+o+c] = t[i*d+c];
+	}
+	return r;
+}
+// Encode the channels of one image for the per dictionary and combined
+// archives (the last record), nothing is encoded for missing archives
+static QVector< TextonRecord > encodeTextons( const QVector< TextonArchiveWriter * > & archives, TextonArchiveWriter * combined, const QString & name, const QVector< Image< short > > & channels ){
+	if (channels.isEmpty())
+		return QVector< TextonRecord >();
+	QVector< TextonRecord > r( archives.count()+1 );
+	for( int k=0; k<channels.count(); k++ )
+		if (archives[k])
+			r[k] = TextonArchiveWriter::encode( name, channels[k] );
+	if (combined)
+		r.last() = TextonArchiveWriter::encode( name, mergeChannels( channels ) );
+	return r;
+}
+static void writeRecords( const QVector< TextonArchiveWriter * > & archives, TextonArchiveWriter * combined, const QVector< TextonRecord > & records ){
+	if (records.isEmpty())
+		return;
+	for( int k=0; k<archives.count(); k++ )
+		if (archives[k])
+			archives[k]->write( records[k] );
+	if (combined)
+		combined->write( records.last() );
+}
+// Textonize and encode the images in parallel (as they are decoded), write
+// them in order
+class TextonizeConsumer: public Dataset::Consumer{
+	const QVector< const Texton * > & textons;
+	const QVector< QString > & names;
+	const QVector< TextonArchiveWriter * > & archives;
+	TextonArchiveWriter * combined;
+	const Dataset & dataset;
+	// Encoded records of the images in flight
+	QVector< TextonRecord > * records;
+public:
+	TextonizeConsumer( const QVector< const Texton * > & textons, const Dataset & dataset, const QVector< TextonArchiveWriter * > & archives, TextonArchiveWriter * combined, QVector< QVector< TextonRecord > > & records ):textons(textons),names(dataset.names()),archives(archives),combined(combined),dataset(dataset),records(records.data()){
+	}
+	void prepare( int i, const ColorImage & image, const LabelImage & ){
+		if (image.width() == 0 || image.height() == 0){
+			qWarning( "Failed to load '%s'", qPrintable( dataset.imageFile( i ) ) );
+			return;
+		}
+		records[i] = encodeTextons( archives, combined, names[i], textonizeChannels( textons, image, names[i] ) );
+	}
+	void operator()( int i, const ColorImage &, const LabelImage & ){
+		writeRecords( archives, combined, records[i] );
+		records[i] = QVector< TextonRecord >();
+	}
+};
+#ifdef USE_TBB
+// One image on it's way through the pipeline
+struct TextonizeItem{
+	int id;
+	// Channels to merge (mergeTextons only)
+	QVector< Image< short > > channels;
+	QVector< TextonRecord > records;
+};
+class TBBReadItem: public tbb::filter{
+	int next_, n_;
+public:
+	TBBReadItem( int n ):tbb::filter( serial_in_order ),next_(0),n_(n){
+	}
+	void * operator()( void * ){
+		if (next_ >= n_)
+			return NULL;
+		TextonizeItem * item = new TextonizeItem;
+		item->id = next_++;
+		return item;
+	}
+};
+class TBBEncodeItem: public tbb::filter{
+	const QVector< Image< short > > & textons;
+	const QVector< QString > & names;
+public:
+	TBBEncodeItem( const QVector< Image< short > > & textons, const QVector< QString > & names ):tbb::filter( parallel ),textons(textons),names(names){
+	}
+	void * operator()( void * p ){
+		TextonizeItem * item = static_cast< TextonizeItem * >( p );
+		item->records.append( TextonArchiveWriter::encode( names[item->id], textons[item->id] ) );
+		item->records.append( TextonRecord() );
+		return item;
+	}
+};
+// Append the records in order
+class TBBWriteItem: public tbb::filter{
+	const QVector< TextonArchiveWriter * > & archives;
+	TextonArchiveWriter * combined;
+public:
+	TBBWriteItem( const QVector< TextonArchiveWriter * > & archives, TextonArchiveWriter * combined ):tbb::filter( serial_in_order ),archives(archives),combined(combined){
+	}
+	void * operator()( void * p ){
+		TextonizeItem * item = static_cast< TextonizeItem * >( p );
+		writeRecords( archives, combined, item->records );
+		delete item;
+		return NULL;
+	}
+};
+#endif
+bool textonizeFiles( const QVector< const Texton * > & textons, const QVector< QString > & texton_files, const QString & combined_file, const Dataset & dataset, int max_images ){
+	// Open all outputs (an empty filename is skipped)
+	QVector< QString > filenames = texton_files;
+	filenames.append( combined_file );
+	QVector< TextonArchiveWriter * > archives;
+	bool ok = true;
+	foreach( QString filename, filenames ){
+		TextonArchiveWriter * archive = NULL;
+		if (!filename.isEmpty()){
+			archive = new TextonArchiveWriter;
+			ok = archive->open( filename ) && ok;
+		}
+		archives.append( archive );
+	}
+	TextonArchiveWriter * combined = archives.last();
+	archives.remove( archives.count()-1 );
+	
+	if (ok){
+		QVector< QVector< TextonRecord > > records( dataset.count() );
+		TextonizeConsumer consumer( textons, dataset, archives, combined, records );
+		dataset.process( consumer, max_images );
+	}
+	// Deleting a writer writes it's index
+	foreach( TextonArchiveWriter * archive, archives )
+		delete archive;
+	delete combined;
+	return ok;
+}
+bool Texton::textonizeFiles(const QString& filename, const Dataset& dataset, int max_images) const {
+	return ::textonizeFiles( QVector< const Texton * >() << this, QVector< QString >() << filename, QString(), dataset, max_images );
+}
 void saveTextons(const QString& filename, const QVector< Image< short > >& textons, const QVector< QString >& names) {
-	QFile file( filename );
-	if (!file.open(QFile::WriteOnly))
+	TextonArchiveWriter archive;
+	if (!archive.open( filename ))
 		qFatal( "Failed to save textons to '%s'", qPrintable( filename ) );
-	QDataStream s( &file );
+#ifdef USE_TBB
+	// Encode in parallel, append in order
+	const QVector< TextonArchiveWriter * > archives( 1, &archive );
+	TBBReadItem read( textons.count() );
+	TBBEncodeItem encode( textons, names );
+	TBBWriteItem write( archives, NULL );
+	tbb::pipeline pipeline;
+	pipeline.add_filter( read );
+	pipeline.add_filter( encode );
+	pipeline.add_filter( write );
+	pipeline.run( 4*tbb::task_scheduler_init::default_num_threads() );
+	pipeline.clear();
+#else
 	for( int i=0; i<textons.count(); i++ )
-		s << names[i] << textons[i];
-	file.close();
+		archive.write( names[i], textons[i] );
+#endif
+	archive.close();
 }
 QVector< Image< short > > loadTextons(const QString& filename, const QVector< QString >& names) {
-	QSet< QString > snames = QSet< QString >::fromList( names.toList() );
-	QFile file( filename );
-	if (!file.open(QFile::ReadOnly))
+	TextonArchiveReader archive;
+	if (!archive.open( filename ))
 		qFatal( "Failed to load textons to '%s'", qPrintable( filename ) );
-	QDataStream s( &file );
+	QVector< Image< short > > r;
+	if (archive.isIndexed()){
+		// Only decode the requested images
+		foreach( QString name, names )
+			r.append( archive.read( name ) );
+		return r;
+	}
+	// Old archive without index, decode everything
+	QSet< QString > snames = QSet< QString >::fromList( names.toList() );
 	QMap< QString, Image< short > > texton_map;
-	while(!s.atEnd()){
-		QString name;
-		Image< short > textons;
-		s >> name >> textons;
+	QString name;
+	Image< short > textons;
+	while( archive.readNext( name, textons ) )
 		if (snames.contains( name ))
 			texton_map[ name ] = textons;
-	}
-	file.close();
 	
-	QVector< Image< short > > r;
 	foreach( QString name, names )
 		r.append( texton_map[name] );
 	return r;
 }
+QVector< Image< short > > loadTextonChannels(const QVector< QString >& filenames, const QVector< QString >& names) {
+	// A single (merged) file needs no copy
+	if (filenames.count() == 1)
+		return loadTextons( filenames.first(), names );
+	QVector< QVector< Image< short > > > archives;
+	foreach( QString filename, filenames )
+		archives.append( loadTextons( filename, names ) );
+	// Interleave the channels of all files
+	QVector< Image< short > > r( names.count() );
+	for( int j=0; j<names.count(); j++ ){
+		QVector< Image< short > > images;
+		bool complete = true;
+		for( int a=0; a<archives.count(); a++ ){
+			images.append( archives[a][j] );
+			complete = complete && images.last().width() > 0;
+			// Free the memory as we go
+			archives[a][j] = Image< short >();
+		}
+		if (complete)
+			r[j] = mergeChannels( images );
+	}
+	return r;
+}
+QVector< int > loadTextonCounts(const QVector< QString >& filenames) {
+	QVector< int > r;
+	foreach( QString filename, filenames ){
+		TextonArchiveReader archive;
+		if (!archive.open( filename ) || archive.textonCounts().isEmpty())
+			return QVector< int >();
+		r += archive.textonCounts();
+	}
+	return r;
+}
+#ifdef USE_TBB
+// Read the same image from all archives
+class TBBReadImages: public tbb::filter{
+	QVector< TextonArchiveReader * > & archives;
+	const QVector< QString > & names;
+	int next_;
+public:
+	TBBReadImages( QVector< TextonArchiveReader * > & archives, const QVector< QString > & names ):tbb::filter( serial_in_order ),archives(archives),names(names),next_(0){
+	}
+	void * operator()( void * ){
+		if (next_ >= names.count())
+			return NULL;
+		TextonizeItem * item = new TextonizeItem;
+		item->id = next_++;
+		foreach( TextonArchiveReader * archive, archives )
+			item->channels.append( archive->read( names[item->id] ) );
+		return item;
+	}
+};
+// Merge and encode in parallel
+class TBBMergeImages: public tbb::filter{
+	const QVector< QString > & names;
+public:
+	TBBMergeImages( const QVector< QString > & names ):tbb::filter( parallel ),names(names){
+	}
+	void * operator()( void * p ){
+		TextonizeItem * item = static_cast< TextonizeItem * >( p );
+		item->records.append( TextonArchiveWriter::encode( names[item->id], mergeChannels( item->channels ) ) );
+		item->records.append( TextonRecord() );
+		item->channels.clear();
+		return item;
+	}
+};
+#endif
+bool mergeTextons(const QVector< QString >& filenames, const QString& merged_file) {
+	QVector< TextonArchiveReader * > archives;
+	bool ok = true;
+	foreach( QString filename, filenames ){
+		archives.append( new TextonArchiveReader );
+		ok = archives.last()->open( filename ) && ok;
+		if (ok && !archives.last()->isIndexed()){
+			qWarning( "'%s' has no index (see indextextons)", qPrintable( filename ) );
+			ok = false;
+		}
+	}
+	// Only merge the images all archives have
+	QVector< QString > names;
+	if (ok)
+		foreach( QString name, archives.first()->names() ){
+			bool found = true;
+			foreach( TextonArchiveReader * archive, archives )
+				found = found && archive->contains( name );
+			if (found)
+				names.append( name );
+		}
+	TextonArchiveWriter merged;
+	if (ok && merged.open( merged_file )){
+#ifdef USE_TBB
+		const QVector< TextonArchiveWriter * > out( 1, &merged );
+		TBBReadImages read( archives, names );
+		TBBMergeImages merge( names );
+		TBBWriteItem write( out, NULL );
+		tbb::pipeline pipeline;
+		pipeline.add_filter( read );
+		pipeline.add_filter( merge );
+		pipeline.add_filter( write );
+		pipeline.run( 4*tbb::task_scheduler_init::default_num_threads() );
+		pipeline.clear();
+#else
+		foreach( QString name, names ){
+			QVector< Image< short > > images;
+			foreach( TextonArchiveReader * archive, archives )
+				images.append( archive->read( name ) );
+			merged.write( name, mergeChannels( images ) );
+		}
+#endif
+		merged.close();
+	}
+	else
+		ok = false;
+	foreach( TextonArchiveReader * archive, archives )
+		delete archive;
+	return ok;
+}
@@ -34,6 +34,9 @@
 #include <Eigen/Core>
 using namespace Eigen;
 
+class ColorImage;
+class Dataset;
+
 class Texton
 {
 	QSharedPointer<Feature> feature_;
@@ -42,11 +45,45 @@ class Texton
 	VectorXd mean_;
 	MatrixXd transformation_;
 public:
-	Texton( QSharedPointer< Feature > feature, int n_textons );
+	// A texton without a feature has to be loaded before use
+	Texton( QSharedPointer< Feature > feature = QSharedPointer< Feature >(), int n_textons = 0 );
 	void train( const QVector< Image< float > >& lab_images, const QVector< QString >& names, int n_samples = 100000  );
 	Image<short> textonize( const Image< float >& lab_image, const QString & name ) const;
 	QVector< Image<short> > textonize( const QVector< Image<float> > & lab_images, const QVector< QString >& names  ) const;
+	// Textonize the images of a dataset one at a time (Lab, feature and
+	// assignment) and append them to a texton file in order (see
+	// saveTextons). At most max_images images are in memory at once.
+	bool textonizeFiles( const QString & filename, const Dataset & dataset, int max_images = 16 ) const;
+	// Save and load the dictionary (feature spec, mean, whitening and cluster
+	// centers). load recreates the feature from the spec, if a feature was
+	// given it has to match the stored one.
+	bool save( const QString & filename ) const;
+	bool load( const QString & filename );
+	QSharedPointer<Feature> feature() const;
 };
 
+// Texton channels of one image, one per dictionary. The image is converted to
+// Lab once and all dictionaries run in parallel on it.
+QVector< Image<short> > textonizeChannels( const QVector< const Texton * > & textons, const ColorImage & image, const QString & name = QString() );
+// Interleave the channels of images of the same size
+Image< short > mergeChannels( const QVector< Image<short> > & images );
+
+// Texton files are indexed archives (see textonarchive.h), loadTextons only
+// decodes the requested images (old archives without index are read fully)
 void saveTextons( const QString & filename , const QVector< Image<short> > & textons, const QVector< QString > & names );
 QVector< Image<short> > loadTextons( const QString & filename , const QVector< QString > & names );
+// Textonize a dataset with several dictionaries in one pass (see
+// Dataset::process, cached images are not decoded), every image is converted
+// to Lab once and all dictionaries run in parallel on it. Channel k is
+// appended to texton_files[k] and all channels (interleaved) to combined_file,
+// empty filenames are skipped.
+bool textonizeFiles( const QVector< const Texton * > & textons, const QVector< QString > & texton_files, const QString & combined_file, const Dataset & dataset, int max_images = 16 );
+// Load several texton files (with one or more channels each) and interleave
+// all their channels in order
+QVector< Image<short> > loadTextonChannels( const QVector< QString > & filenames, const QVector< QString > & names );
+// Number of textons per channel of loadTextonChannels, empty if a file does
+// not store them
+QVector< int > loadTextonCounts( const QVector< QString > & filenames );
+// Merge indexed texton files into one multi-channel archive (of the images
+// found in all files)
+bool mergeTextons( const QVector< QString > & filenames, const QString & merged_file );
@@ -0,0 +1,194 @@
+/*
+    Copyright (c) 2011, Philipp Krähenbühl
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+        * Neither the name of the Stanford University nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY Philipp Krähenbühl ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL Philipp Krähenbühl BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "textonarchive.h"
+#include <QBuffer>
+
+static const quint32 ARCHIVE_MAGIC = 0x54784172; // "TxAr"
+// Version 2 added the texton counts
+static const quint32 ARCHIVE_VERSION = 2;
+// Index offset, version and magic
+static const int FOOTER_SIZE = 16;
+
+QDataStream & operator<<( QDataStream & s, const TextonIndexEntry & e ){
+	return s << e.offset << e.length << e.width << e.height << e.depth;
+}
+QDataStream & operator>>( QDataStream & s, TextonIndexEntry & e ){
+	return s >> e.offset >> e.length >> e.width >> e.height >> e.depth;
+}
+
+TextonArchiveWriter::TextonArchiveWriter() {
+}
+TextonArchiveWriter::~TextonArchiveWriter() {
+	close();
+}
+bool TextonArchiveWriter::open(const QString& filename) {
+	close();
+	index_.clear();
+	counts_.clear();
+	file_.setFileName( filename );
+	if (!file_.open( QFile::WriteOnly )){
+		qWarning( "Failed to save textons to '%s'", qPrintable( filename ) );
+		return false;
+	}
+	stream_.setDevice( &file_ );
+	return true;
+}
+bool TextonArchiveWriter::isOpen() const {
+	return file_.isOpen();
+}
+TextonRecord TextonArchiveWriter::encode(const QString& name, const Image< short >& textons) {
+	TextonRecord r;
+	r.name = name;
+	r.width = textons.width();
+	r.height = textons.height();
+	r.depth = textons.depth();
+	r.counts.fill( 0, r.depth );
+	const short * t = textons.data();
+	for( int i=0; i<r.width*r.height; i++ )
+		for( int k=0; k<r.depth; k++, t++ )
+			if (r.counts[k] <= *t)
+				r.counts[k] = *t+1;
+	QBuffer buffer( &r.data );
+	buffer.open( QIODevice::WriteOnly );
+	QDataStream s( &buffer );
+	s << name << textons;
+	buffer.close();
+	return r;
+}
+void TextonArchiveWriter::write(const TextonRecord& record) {
+	TextonIndexEntry e;
+	e.offset = file_.pos();
+	e.length = record.data.size();
+	e.width = record.width;
+	e.height = record.height;
+	e.depth = record.depth;
+	file_.write( record.data );
+	index_[ record.name ] = e;
+	if (counts_.count() < record.counts.count())
+		counts_.resize( record.counts.count() );
+	for( int k=0; k<record.counts.count(); k++ )
+		counts_[k] = qMax( counts_[k], record.counts[k] );
+}
+void TextonArchiveWriter::write(const QString& name, const Image< short >& textons) {
+	write( encode( name, textons ) );
+}
+void TextonArchiveWriter::close() {
+	if (!file_.isOpen())
+		return;
+	const qint64 index_offset = file_.pos();
+	stream_ << (int)index_.count();
+	foreach( QString name, index_.keys() )
+		stream_ << name << index_[ name ];
+	stream_ << counts_;
+	stream_ << index_offset << ARCHIVE_VERSION << ARCHIVE_MAGIC;
+	stream_.setDevice( NULL );
+	file_.close();
+}
+
+TextonArchiveReader::TextonArchiveReader():indexed_(false),status_(QDataStream::Ok) {
+}
+bool TextonArchiveReader::open(const QString& filename) {
+	file_.close();
+	index_.clear();
+	counts_.clear();
+	indexed_ = false;
+	status_ = QDataStream::Ok;
+	file_.setFileName( filename );
+	if (!file_.open( QFile::ReadOnly )){
+		qWarning( "Failed to load textons from '%s'", qPrintable( filename ) );
+		return false;
+	}
+	QDataStream s( &file_ );
+	if (file_.size() >= FOOTER_SIZE){
+		file_.seek( file_.size() - FOOTER_SIZE );
+		qint64 index_offset;
+		quint32 version, magic;
+		s >> index_offset >> version >> magic;
+		if (magic == ARCHIVE_MAGIC && version >= 1 && version <= ARCHIVE_VERSION && index_offset >= 0 && index_offset < file_.size()){
+			file_.seek( index_offset );
+			int n;
+			s >> n;
+			for( int i=0; i<n; i++ ){
+				QString name;
+				TextonIndexEntry e;
+				s >> name >> e;
+				index_[ name ] = e;
+			}
+			if (version >= 2)
+				s >> counts_;
+			if (s.status() != QDataStream::Ok){
+				qWarning( "Corrupt texton index in '%s'", qPrintable( filename ) );
+				index_.clear();
+				return false;
+			}
+			indexed_ = true;
+		}
+	}
+	file_.seek( 0 );
+	return true;
+}
+bool TextonArchiveReader::isIndexed() const {
+	return indexed_;
+}
+QVector< QString > TextonArchiveReader::names() const {
+	return index_.keys().toVector();
+}
+bool TextonArchiveReader::contains(const QString& name) const {
+	return index_.contains( name );
+}
+TextonIndexEntry TextonArchiveReader::entry(const QString& name) const {
+	return index_.value( name );
+}
+QVector< int > TextonArchiveReader::textonCounts() const {
+	return counts_;
+}
+Image< short > TextonArchiveReader::read(const QString& name) {
+	Image< short > r;
+	if (!index_.contains( name ))
+		return r;
+	file_.seek( index_[ name ].offset );
+	QDataStream s( &file_ );
+	QString stored_name;
+	s >> stored_name >> r;
+	return r;
+}
+bool TextonArchiveReader::readNext(QString& name, Image< short >& textons) {
+	if (indexed_ || file_.atEnd())
+		return false;
+	QDataStream s( &file_ );
+	s >> name >> textons;
+	status_ = s.status();
+	return status_ == QDataStream::Ok;
+}
+bool TextonArchiveReader::atEnd() const {
+	return file_.atEnd();
+}
+QDataStream::Status TextonArchiveReader::status() const {
+	return status_;
+}
@@ -0,0 +1,111 @@
+/*
+    Copyright (c) 2011, Philipp Krähenbühl
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+        * Neither the name of the Stanford University nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY Philipp Krähenbühl ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL Philipp Krähenbühl BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#pragma once
+
+#include "util/image.h"
+#include <QFile>
+#include <QDataStream>
+#include <QByteArray>
+#include <QMap>
+#include <QString>
+#include <QVector>
+
+// Location of one image in an indexed texton archive
+struct TextonIndexEntry{
+	qint64 offset, length;
+	int width, height, depth;
+	TextonIndexEntry():offset(0),length(0),width(0),height(0),depth(0){
+	}
+};
+QDataStream & operator<<( QDataStream & s, const TextonIndexEntry & e );
+QDataStream & operator>>( QDataStream & s, TextonIndexEntry & e );
+
+// One serialized (name, textons) record
+struct TextonRecord{
+	QString name;
+	QByteArray data;
+	int width, height, depth;
+	// Largest texton + 1 per channel
+	QVector< int > counts;
+	TextonRecord():width(0),height(0),depth(0){
+	}
+};
+
+// A texton archive is a sequence of (name, textons) records followed by an
+// index (name -> TextonIndexEntry), the number of textons per channel and a
+// fixed size footer (index offset, version and magic number). Archives
+// written before the index existed are plain record sequences.
+class TextonArchiveWriter{
+protected:
+	QFile file_;
+	QDataStream stream_;
+	QMap< QString, TextonIndexEntry > index_;
+	QVector< int > counts_;
+public:
+	TextonArchiveWriter();
+	~TextonArchiveWriter();
+	bool open( const QString & filename );
+	bool isOpen() const;
+	// Serialize a record, this does all the compression and is thread safe.
+	// The bytes only depend on the input, never on the thread.
+	static TextonRecord encode( const QString & name, const Image< short > & textons );
+	// Append an encoded record
+	void write( const TextonRecord & record );
+	void write( const QString & name, const Image< short > & textons );
+	// Write the index and the footer
+	void close();
+};
+
+class TextonArchiveReader{
+protected:
+	QFile file_;
+	QMap< QString, TextonIndexEntry > index_;
+	QVector< int > counts_;
+	bool indexed_;
+	QDataStream::Status status_;
+public:
+	TextonArchiveReader();
+	bool open( const QString & filename );
+	// False for archives without an index, those can only be read in order
+	bool isIndexed() const;
+	QVector< QString > names() const;
+	bool contains( const QString & name ) const;
+	TextonIndexEntry entry( const QString & name ) const;
+	// Number of textons per channel over all images (empty if not stored)
+	QVector< int > textonCounts() const;
+	// Seek to the image and decode it (empty if name is not in the archive)
+	Image< short > read( const QString & name );
+	// Read the next record of an archive without index, false at the end
+	// or on a corrupted record
+	bool readNext( QString & name, Image< short > & textons );
+	// True if readNext read up to the end of the file
+	bool atEnd() const;
+	// Status of the last readNext
+	QDataStream::Status status() const;
+};
@@ -0,0 +1,79 @@
+/*
+    Copyright (c) 2011, Philipp Krähenbühl
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+        * Neither the name of the Stanford University nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY Philipp Krähenbühl ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL Philipp Krähenbühl BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "feature/textonarchive.h"
+#include <QVector>
+#include <QString>
+
+// Add an index to texton archives written before the index existed
+static bool convert( const QString & filename ){
+	TextonArchiveReader reader;
+	if (!reader.open( filename ))
+		return false;
+	if (reader.isIndexed()){
+		qDebug( "'%s' is already indexed", qPrintable( filename ) );
+		return true;
+	}
+	const QString tmp_filename = filename + ".tmp";
+	TextonArchiveWriter writer;
+	if (!writer.open( tmp_filename ))
+		return false;
+	// Copy one image at a time
+	QString name;
+	Image< short > textons;
+	int n = 0;
+	while( reader.readNext( name, textons ) ){
+		writer.write( name, textons );
+		n++;
+	}
+	writer.close();
+	// Keep the original if it could not be read completely
+	if (!reader.atEnd() || reader.status() != QDataStream::Ok){
+		qWarning( "Failed to read '%s' after %d images, keeping the original", qPrintable( filename ), n );
+		QFile::remove( tmp_filename );
+		return false;
+	}
+	if (!QFile::remove( filename ) || !QFile::rename( tmp_filename, filename )){
+		qWarning( "Failed to replace '%s' with '%s'", qPrintable( filename ), qPrintable( tmp_filename ) );
+		return false;
+	}
+	qDebug( "Indexed %d images in '%s'", n, qPrintable( filename ) );
+	return true;
+}
+
+int main( int argc, char * argv[]){
+	if (argc<2){
+		qWarning( "Usage: %s texton_file [texton_file ...]", argv[0] );
+		qWarning( "     Converts old texton files to indexed archives (in place)" );
+		return 1;
+	}
+	bool ok = true;
+	for( int i=1; i<argc; i++ )
+		ok = convert( argv[i] ) && ok;
+	return ok ? 0 : 1;
+}
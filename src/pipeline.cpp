@@ -0,0 +1,129 @@
+/*
+    Copyright (c) 2011, Philipp Krähenbühl
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+        * Neither the name of the Stanford University nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY Philipp Krähenbühl ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL Philipp Krähenbühl BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "util/colorimage.h"
+#include "config.h"
+#include <QVector>
+#include <QString>
+#include <QDir>
+#include <QFileInfo>
+#include "classifier/pipeline.h"
+
+#ifdef USE_TBB
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+#endif
+
+static void evaluate( const Pipeline & pipeline, const QString & image_file, const QString & save_dir ){
+	ColorImage image;
+	image.load( image_file );
+	if (image.width() == 0 || image.height() == 0){
+		qWarning( "Failed to load '%s'", qPrintable( image_file ) );
+		return;
+	}
+	const QString name = QFileInfo( image_file ).completeBaseName();
+	Image<float> r = pipeline.evaluate( image, name );
+	
+	// Save the result
+	QFile file( save_dir + "/" + name + ".unary" );
+	if (file.open( QFile::WriteOnly ) ){
+		QDataStream stream( &file );
+		
+		// We want to write floats [saves 2x space]
+		stream.setVersion( QDataStream::Qt_4_7 );
+		stream.setFloatingPointPrecision( QDataStream::SinglePrecision );
+		
+		stream << r;
+	}
+	file.close();
+}
+
+#ifdef USE_TBB
+class TBBPipeline{
+	const Pipeline & pipeline;
+	const QVector<QString> & image_files;
+	const QString & save_dir;
+public:
+	TBBPipeline( const Pipeline & pipeline, const QVector<QString> & image_files, const QString & save_dir ):pipeline(pipeline), image_files(image_files), save_dir(save_dir){}
+	void operator()( tbb::blocked_range<int> rng ) const{
+		for( int i=rng.begin(); i<rng.end(); i++ ){
+			qDebug("Doing Image %d", i );
+			evaluate( pipeline, image_files[i], save_dir );
+		}
+	}
+};
+void evaluate_all( const Pipeline & pipeline, const QVector<QString> & image_files, const QString & save_dir ){
+	tbb::parallel_for(tbb::blocked_range<int>(0, image_files.size(), 1), TBBPipeline(pipeline, image_files, save_dir));
+}
+#else
+void evaluate_all( const Pipeline & pipeline, const QVector<QString> & image_files, const QString & save_dir ){
+	for( int i=0; i<image_files.count(); i++ ){
+		qDebug("Doing Image %d", i );
+		evaluate( pipeline, image_files[i], save_dir );
+	}
+}
+#endif
+int main( int argc, char * argv[]){
+	/**** Read the IO ****/
+	QVector< QString > args;
+	EvaluateOptions options;
+	Pipeline pipeline;
+	int n_textons = 0;
+	for( int i=0; i<argc; i++ ){
+		QString arg = argv[i];
+		if (arg == "--texton" && i+1<argc){
+			if (!pipeline.addTexton( argv[++i] ))
+				return 1;
+			n_textons++;
+		}
+		else if (arg == "--compact")
+			options.compact_integral = true;
+		else if (arg == "--subsample" && i+1<argc)
+			options.subsample = QString( argv[++i] ).toInt();
+		else
+			args.append( arg );
+	}
+	if (args.count()<4 || n_textons == 0){
+		qWarning( "Usage: %s --texton dictionary [--texton ...] [options] classifier_file save_dir image_file [image_file ...]", argv[0] );
+		qWarning( "     --texton d   : Texton channel with the dictionary d saved by textonize --dictionary" );
+		qWarning( "     --compact    : Use a 16 bit integral histogram (less memory)" );
+		qWarning( "     --subsample s: Only evaluate every s'th pixel (0 = training subsample)" );
+		return 1;
+	}
+	pipeline.setOptions( options );
+	if (!pipeline.loadClassifier( args[1] ))
+		return 1;
+	
+	// Create the output directory
+	QString save_dir = args[2];
+	QDir dir( save_dir );
+	if (!dir.exists())
+		dir.mkpath( dir.absolutePath() );
+	
+	evaluate_all( pipeline, args.mid( 3 ), save_dir );
+	return 0;
+}
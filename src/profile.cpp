@@ -0,0 +1,102 @@
+/*
+    Copyright (c) 2011, Philipp Krähenbühl
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+        * Neither the name of the Stanford University nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY Philipp Krähenbühl ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL Philipp Krähenbühl BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "util/labelimage.h"
+#include "util/colorimage.h"
+#include "util/util.h"
+#include "util/dataset.h"
+#include "feature/texton.h"
+#include "settings.h"
+#include <QVector>
+#include <QString>
+#include <QFile>
+#include <QTextStream>
+#include "classifier/textonboost.h"
+
+int main( int argc, char * argv[]){
+	/**** Read the IO ****/
+	QVector< QString > args;
+	int step = 10;
+	for( int i=0; i<argc; i++ ){
+		QString arg = argv[i];
+		if (arg == "--step" && i+1<argc)
+			step = QString( argv[++i] ).toInt();
+		else
+			args.append( arg );
+	}
+	if (args.count()<4 || step < 1){
+		qWarning( "Usage: %s [--step k] classifier_file csv_file texton_file [texton_file ...]", argv[0] );
+		qWarning( "     --step k : Record the validation accuracy every k rounds (default 10)" );
+		return 1;
+	}
+	TextonBoost booster;
+	booster.load( args[1] );
+	
+	// Load the validation set
+	Dataset dataset( VALID, Dataset::LABELS );
+	QVector< LabelImage > labels = dataset.labels();
+	
+	QVector< Image<short> > textons = loadTextonChannels( args.mid( 3 ), dataset.names() );
+	
+	// Stream all images through the model once
+	QVector< QVector< long long > > correct, total;
+	for( int i=0; i<textons.count(); i++ ){
+		qDebug("Profiling Image %d", i );
+		booster.profileRounds( textons[i], labels[i], step, correct, total );
+	}
+	
+	// and write the accuracy curve
+	QFile file( args[2] );
+	if (!file.open( QFile::WriteOnly )){
+		qWarning( "Failed to write '%s'", qPrintable( args[2] ) );
+		return 1;
+	}
+	QTextStream out( &file );
+	const int n_classes = correct.count() ? correct.first().count() : 0;
+	out << "rounds,pixel_accuracy,class_accuracy";
+	for( int c=0; c<n_classes; c++ )
+		out << ",class_" << c;
+	out << "\n";
+	for( int n=0; n<correct.count(); n++ ){
+		long long n_correct = 0, n_total = 0;
+		double class_accuracy = 0;
+		int n_present = 0;
+		QString per_class;
+		for( int c=0; c<n_classes; c++ ){
+			n_correct += correct[n][c];
+			n_total += total[n][c];
+			double accuracy = total[n][c] ? (double)correct[n][c] / total[n][c] : 0;
+			if (total[n][c]){
+				class_accuracy += accuracy;
+				n_present++;
+			}
+			per_class += "," + QString::number( accuracy );
+		}
+		out << qMin( (n+1)*step, booster.numRounds() ) << "," << (n_total ? (double)n_correct / n_total : 0.0) << "," << (n_present ? class_accuracy / n_present : 0.0) << per_class << "\n";
+	}
+	return 0;
+}
@@ -0,0 +1,109 @@
+/*
+    Copyright (c) 2011, Philipp Krähenbühl
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+        * Neither the name of the Stanford University nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY Philipp Krähenbühl ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL Philipp Krähenbühl BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "util/labelimage.h"
+#include "util/colorimage.h"
+#include "util/util.h"
+#include "util/dataset.h"
+#include "feature/texton.h"
+#include "settings.h"
+#include <QVector>
+#include <QString>
+#include <QFileInfo>
+#include <QTime>
+#include <cmath>
+#include "classifier/textonboost.h"
+#include "classifier/quantizedtextonboost.h"
+
+static int argmax( const float * p, int n ){
+	int r = 0;
+	for( int i=1; i<n; i++ )
+		if (p[i] > p[r])
+			r = i;
+	return r;
+}
+
+int main( int argc, char * argv[]){
+	/**** Read the IO ****/
+	if (argc<3){
+		qWarning( "Usage: %s classifier_file quantized_file [texton_file ...]", argv[0] );
+		qWarning( "     Compares both models on the test set if texton files are given" );
+		return 1;
+	}
+	TextonBoost booster;
+	booster.load( argv[1] );
+	QuantizedTextonBoost quantized( booster );
+	quantized.save( argv[2] );
+	qDebug( "Quantized %d rounds: %d bytes in memory, file %lld -> %lld bytes", quantized.numRounds(), quantized.modelSize(), QFileInfo( argv[1] ).size(), QFileInfo( argv[2] ).size() );
+	if (argc<4)
+		return 0;
+	
+	/**** Agreement report ****/
+	Dataset dataset( TEST, Dataset::LABELS );
+	QVector< LabelImage > labels = dataset.labels();
+	
+	QVector< QString > texton_files;
+	for( int i=3; i<argc; i++ )
+		texton_files.append( argv[i] );
+	QVector< Image<short> > textons = loadTextonChannels( texton_files, dataset.names() );
+	
+	EvaluateOptions options;
+	options.compact_integral = true;
+	long long n_pixels = 0, n_agree = 0, n_correct = 0, n_correct_quantized = 0, n_labeled = 0;
+	double max_error = 0;
+	int float_time = 0, quantized_time = 0;
+	for( int i=0; i<textons.count(); i++ ){
+		QTime timer;
+		timer.start();
+		Image<float> r = booster.evaluate( textons[i], options );
+		float_time += timer.restart();
+		Image<float> q = quantized.evaluate( textons[i], options );
+		quantized_time += timer.elapsed();
+		
+		const int C = r.depth();
+		for( int j=0; j<r.height(); j++ )
+			for( int x=0; x<r.width(); x++ ){
+				const float * pr = r.data() + (j*r.width()+x)*C, * pq = q.data() + (j*q.width()+x)*C;
+				int lr = argmax( pr, C ), lq = argmax( pq, C );
+				for( int c=0; c<C; c++ )
+					max_error = qMax( max_error, (double)fabs( pr[c]-pq[c] ) );
+				n_pixels++;
+				n_agree += (lr == lq);
+				if (labels[i](x,j) >= 0){
+					n_labeled++;
+					n_correct += (labels[i](x,j) == lr);
+					n_correct_quantized += (labels[i](x,j) == lq);
+				}
+			}
+	}
+	qDebug( "Label agreement   %lld / %lld (%0.4f%%)", n_agree, n_pixels, 100.0*n_agree / qMax( n_pixels, 1ll ) );
+	qDebug( "Max score error   %g", max_error );
+	qDebug( "Accuracy float    %0.4f%%", 100.0*n_correct / qMax( n_labeled, 1ll ) );
+	qDebug( "Accuracy quantized %0.4f%%", 100.0*n_correct_quantized / qMax( n_labeled, 1ll ) );
+	qDebug( "Time float %d ms, quantized %d ms", float_time, quantized_time );
+	return 0;
+}
@@ -0,0 +1,530 @@
+/*
+    Copyright (c) 2011, Philipp Krähenbühl
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+        * Neither the name of the Stanford University nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY Philipp Krähenbühl ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL Philipp Krähenbühl BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "util/colorimage.h"
+#include "util/labelimage.h"
+#include "util/util.h"
+#include "util/dataset.h"
+#include "feature/texton.h"
+#include "settings.h"
+#include "config.h"
+#include <QVector>
+#include <QString>
+#include <QMap>
+#include <QFile>
+#include <QByteArray>
+#include <QStringList>
+#include "classifier/textonboost.h"
+#include "classifier/quantizedtextonboost.h"
+#include "classifier/flattextonboost.h"
+#include "classifier/pipeline.h"
+#include <QImage>
+#include <QFileInfo>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+#include <algorithm>
+
+#ifdef USE_TBB
+#include <tbb/task_scheduler_init.h>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+#endif
+
+// Protocol (one request per line, the answers start with "ok" or "error"):
+//   name <output> <image>          Evaluate the preloaded textons of an image
+//   raw <output> <w> <h> <d>       Evaluate the w*h*d shorts (native byte
+//                                  order) that follow the line
+//   image <output> <path>          Decode, textonize (with the --dictionary
+//                                  files) and evaluate an image file
+//   stats                          Answer "ok n p50_ms p99_ms" (n requests
+//                                  served, percentiles of the last 10000)
+//   quit                           Close the connection
+// If output is "-" the answer is "ok <w> <h> <classes>" followed by the raw
+// float scores, otherwise the scores are saved to output (as evaluate does)
+// and the answer is "ok <output>".
+
+static volatile sig_atomic_t running = 1;
+static void stop( int ){
+	running = 0;
+}
+static double now(){
+	timespec t;
+	clock_gettime( CLOCK_MONOTONIC, &t );
+	return t.tv_sec*1e3 + t.tv_nsec*1e-6;
+}
+// All requests are answered in order, only the ones with textons or an image
+// are evaluated
+struct Request{
+	int client;
+	// Answer with the latency statistics, close the connection afterwards
+	bool stats, quit;
+	QString output, error;
+	// Image file to textonize
+	QString image;
+	Image<short> textons;
+	Image<float> scores;
+	// Time the request was completely received
+	double received;
+	Request( int client=-1 ):client(client),stats(false),quit(false),received(now()){
+	}
+};
+
+class Client{
+public:
+	int in, out;
+	QByteArray buffer;
+	// Answers not written yet, the first sent bytes are already written
+	QByteArray outgoing;
+	qint64 sent;
+	bool closed;
+	Client( int in=-1, int out=-1 ):in(in),out(out),sent(0),closed(false){
+	}
+	// Read everything available, returns false at the end of the stream
+	bool receive(){
+		char data[1<<16];
+		ssize_t n = read( in, data, sizeof(data) );
+		if (n < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK))
+			return true;
+		if (n <= 0)
+			return false;
+		buffer.append( data, n );
+		return true;
+	}
+	// Take the next complete request line (and its payload) from the buffer
+	bool next( QStringList & command, QByteArray & payload ){
+		int eol = buffer.indexOf( '\n' );
+		if (eol < 0)
+			return false;
+		command = QString::fromLocal8Bit( buffer.constData(), eol ).split( ' ', QString::SkipEmptyParts );
+		qint64 n_payload = 0;
+		if (command.count() == 5 && command[0] == "raw"){
+			n_payload = (qint64)command[2].toInt() * command[3].toInt() * command[4].toInt() * sizeof(short);
+			// Don't wait for absurd payloads, they are rejected later
+			if (n_payload < 0 || n_payload > (1ll<<31))
+				n_payload = 0;
+		}
+		if (buffer.size() < eol+1+n_payload)
+			return false;
+		payload = buffer.mid( eol+1, n_payload );
+		buffer.remove( 0, eol+1+n_payload );
+		return true;
+	}
+	void answer( const QString & s ){
+		outgoing.append( (s + "\n").toLocal8Bit() );
+	}
+	void answer( const char * data, qint64 n ){
+		outgoing.append( data, n );
+	}
+	bool pending() const{
+		return sent < outgoing.size();
+	}
+	// Write as much as possible without blocking (sockets are non-blocking),
+	// a failed connection is closed and it's answers dropped
+	void send(){
+		while( pending() ){
+			ssize_t w = write( out, outgoing.constData()+sent, outgoing.size()-sent );
+			if (w < 0 && errno == EINTR)
+				continue;
+			if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+				return;
+			if (w <= 0){
+				closed = true;
+				break;
+			}
+			sent += w;
+		}
+		outgoing.clear();
+		sent = 0;
+	}
+};
+
+static void saveScores( const Image<float> & r, const QString & save_file, QString & error ){
+	QFile file( save_file );
+	if (!file.open( QFile::WriteOnly )){
+		error = "failed to write '" + save_file + "'";
+		return;
+	}
+	QDataStream stream( &file );
+	// We want to write floats [saves 2x space]
+	stream.setVersion( QDataStream::Qt_4_7 );
+	stream.setFloatingPointPrecision( QDataStream::SinglePrecision );
+	stream << r;
+	file.close();
+}
+
+template<typename B>
+static void evaluateRequest( const B & booster, const Pipeline & textonizer, Request & request, const EvaluateOptions & options ){
+	if (!request.image.isEmpty()){
+		// Decode exactly like the training images and the pipeline tool
+		QImage qim;
+		if (!qim.load( request.image )){
+			request.error = "failed to load '" + request.image + "'";
+			return;
+		}
+		ColorImage image;
+		image = qim;
+		request.textons = textonizer.textonize( image, QFileInfo( request.image ).completeBaseName() );
+	}
+	if (request.textons.width() == 0)
+		return;
+	request.scores = booster.evaluate( request.textons, options );
+	request.textons = Image<short>();
+	if (request.output != "-")
+		saveScores( request.scores, request.output, request.error );
+}
+#ifdef USE_TBB
+template<typename B>
+class TBBServe{
+	const B & booster;
+	const Pipeline & textonizer;
+	QVector< Request > & batch;
+	const EvaluateOptions & options;
+public:
+	TBBServe( const B & booster, const Pipeline & textonizer, QVector< Request > & batch, const EvaluateOptions & options ):booster(booster), textonizer(textonizer), batch(batch), options(options){}
+	void operator()( tbb::blocked_range<int> rng ) const{
+		for( int i=rng.begin(); i<rng.end(); i++ )
+			evaluateRequest( booster, textonizer, batch[i], options );
+	}
+};
+template<typename B>
+static void evaluateBatch( const B & booster, const Pipeline & textonizer, QVector< Request > & batch, const EvaluateOptions & options ){
+	tbb::parallel_for( tbb::blocked_range<int>(0, batch.count(), 1), TBBServe<B>( booster, textonizer, batch, options ) );
+}
+#else
+template<typename B>
+static void evaluateBatch( const B & booster, const Pipeline & textonizer, QVector< Request > & batch, const EvaluateOptions & options ){
+	for( int i=0; i<batch.count(); i++ )
+		evaluateRequest( booster, textonizer, batch[i], options );
+}
+#endif
+
+// Latencies (in ms) of the last SIZE requests in a ring
+class LatencyWindow{
+	static const int SIZE = 10000;
+	QVector< double > latency_;
+	int next_, count_;
+public:
+	LatencyWindow():next_(0),count_(0){
+	}
+	void add( double ms ){
+		if (latency_.count() < SIZE)
+			latency_.append( ms );
+		else
+			latency_[next_] = ms;
+		next_ = (next_+1) % SIZE;
+		count_++;
+	}
+	// Number of requests since the start
+	int count() const{
+		return count_;
+	}
+	// Median and 99th percentile of the window
+	void percentiles( double & p50, double & p99 ) const{
+		p50 = p99 = 0;
+		if (latency_.isEmpty())
+			return;
+		QVector< double > l = latency_;
+		const int k50 = qMin( (int)(0.5 * l.count()), l.count()-1 ), k99 = qMin( (int)(0.99 * l.count()), l.count()-1 );
+		std::nth_element( l.begin(), l.begin()+k50, l.end() );
+		p50 = l[k50];
+		std::nth_element( l.begin()+k50, l.begin()+k99, l.end() );
+		p99 = l[k99];
+	}
+};
+
+template<typename B>
+static bool serve( const B & booster, const Pipeline & textonizer, const QMap< QString, Image<short> > & textons, int listener, const EvaluateOptions & options ){
+	if (textonizer.numChannels() > 0 && textonizer.numChannels() != booster.numChannels()){
+		qWarning( "The classifier expects %d texton channels, got %d dictionaries", booster.numChannels(), textonizer.numChannels() );
+		return false;
+	}
+	QVector< Client > clients;
+	if (listener < 0)
+		clients.append( Client( 0, 1 ) );
+	LatencyWindow latency;
+	
+	while( running ){
+		// Collect all complete requests of all clients into one batch, clients
+		// still receiving their last answers have to wait
+		QVector< Request > batch;
+		for( int c=0; c<clients.count(); c++ ){
+			QStringList command;
+			QByteArray payload;
+			while( !clients[c].closed && !clients[c].pending() && clients[c].next( command, payload ) ){
+				Request request( c );
+				if (command.count() == 1 && command[0] == "stats")
+					request.stats = true;
+				else if (command.count() == 1 && command[0] == "quit")
+					request.quit = clients[c].closed = true;
+				else if (command.count() == 3 && command[0] == "name"){
+					request.output = command[1];
+					if (textons.contains( command[2] ))
+						request.textons = textons[ command[2] ];
+					else
+						request.error = "unknown image '" + command[2] + "'";
+				}
+				else if (command.count() == 3 && command[0] == "image"){
+					request.output = command[1];
+					if (textonizer.numChannels() > 0)
+						request.image = command[2];
+					else
+						request.error = "no texton dictionaries loaded (--dictionary)";
+				}
+				else if (command.count() == 5 && command[0] == "raw"){
+					const int w = command[2].toInt(), h = command[3].toInt(), d = command[4].toInt();
+					request.output = command[1];
+					if (w <= 0 || h <= 0 || d != booster.numChannels() || payload.size() != (qint64)w*h*d*(int)sizeof(short)){
+						// We can't find the next request anymore
+						request.error = QString("expected %1 texton channels").arg( booster.numChannels() );
+						request.quit = clients[c].closed = true;
+					}
+					else{
+						request.textons = Image<short>( w, h, d );
+						memcpy( request.textons.data(), payload.constData(), payload.size() );
+					}
+				}
+				else
+					request.error = "unknown request '" + command.join(" ") + "'";
+				batch.append( request );
+			}
+		}
+		if (!batch.isEmpty()){
+			evaluateBatch( booster, textonizer, batch, options );
+			for( int i=0; i<batch.count(); i++ ){
+				Client & client = clients[ batch[i].client ];
+				const Image<float> & r = batch[i].scores;
+				if (batch[i].stats){
+					double p50, p99;
+					latency.percentiles( p50, p99 );
+					client.answer( QString("ok %1 %2 %3").arg( latency.count() ).arg( p50 ).arg( p99 ) );
+				}
+				else if (!batch[i].error.isEmpty())
+					client.answer( "error " + batch[i].error );
+				else if (batch[i].quit)
+					continue;
+				else if (batch[i].output != "-")
+					client.answer( "ok " + batch[i].output );
+				else{
+					client.answer( QString("ok %1 %2 %3").arg( r.width() ).arg( r.height() ).arg( r.depth() ) );
+					client.answer( (const char*)r.data(), (qint64)r.width()*r.height()*r.depth()*sizeof(float) );
+				}
+				if (r.width() > 0)
+					latency.add( now() - batch[i].received );
+			}
+			for( int c=0; c<clients.count(); c++ )
+				clients[c].send();
+			continue;
+		}
+		
+		// Drop closed connections once their answers are written (stdin ends
+		// the server)
+		bool done = false;
+		for( int c=clients.count()-1; c>=0; c-- )
+			if (clients[c].closed && !clients[c].pending()){
+				if (listener < 0){
+					done = true;
+					break;
+				}
+				close( clients[c].in );
+				clients.remove( c );
+			}
+		if (done)
+			break;
+		
+		// Wait for new connections, data or clients ready to receive answers
+		QVector< pollfd > fds;
+		QVector< int > fd_client;
+		for( int c=0; c<clients.count(); c++ ){
+			// Don't read from clients that are behind on their answers
+			const short in_events = clients[c].closed || clients[c].pending() ? 0 : POLLIN, out_events = clients[c].pending() ? POLLOUT : 0;
+			if (clients[c].in == clients[c].out){
+				pollfd p = { clients[c].in, (short)(in_events | out_events), 0 };
+				fds.append( p );
+				fd_client.append( c );
+				continue;
+			}
+			if (in_events){
+				pollfd p = { clients[c].in, in_events, 0 };
+				fds.append( p );
+				fd_client.append( c );
+			}
+			if (out_events){
+				pollfd p = { clients[c].out, out_events, 0 };
+				fds.append( p );
+				fd_client.append( c );
+			}
+		}
+		if (listener >= 0){
+			pollfd p = { listener, POLLIN, 0 };
+			fds.append( p );
+		}
+		if (poll( fds.data(), fds.count(), -1 ) < 0)
+			continue;
+		for( int i=0; i<fd_client.count(); i++ ){
+			Client & client = clients[ fd_client[i] ];
+			if (!fds[i].revents)
+				continue;
+			if ((fds[i].events & POLLOUT) && client.pending())
+				client.send();
+			if ((fds[i].events & POLLIN) && !client.closed && !client.receive())
+				client.closed = true;
+		}
+		if (listener >= 0 && fds.last().revents){
+			int fd = accept( listener, NULL, NULL );
+			if (fd >= 0){
+				// A slow client must not block the others
+				fcntl( fd, F_SETFL, fcntl( fd, F_GETFL ) | O_NONBLOCK );
+				clients.append( Client( fd, fd ) );
+			}
+		}
+	}
+	double p50, p99;
+	latency.percentiles( p50, p99 );
+	qDebug( "Served %d requests, latency p50 %0.2f ms p99 %0.2f ms", latency.count(), p50, p99 );
+	return true;
+}
+
+static int listenUnix( const QString & path ){
+	int fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+	sockaddr_un addr;
+	memset( &addr, 0, sizeof(addr) );
+	addr.sun_family = AF_UNIX;
+	QByteArray name = QFile::encodeName( path );
+	if (fd < 0 || name.size() >= (int)sizeof(addr.sun_path))
+		return -1;
+	strcpy( addr.sun_path, name.constData() );
+	unlink( addr.sun_path );
+	if (bind( fd, (sockaddr*)&addr, sizeof(addr) ) < 0 || listen( fd, 64 ) < 0){
+		close( fd );
+		return -1;
+	}
+	return fd;
+}
+
+int main( int argc, char * argv[]){
+	/**** Read the IO ****/
+	QVector< QString > args;
+	EvaluateOptions options;
+	QString socket_path;
+	QVector< QString > dictionaries;
+	bool quantized = false, flat = false;
+	int n_threads = 0;
+	for( int i=0; i<argc; i++ ){
+		QString arg = argv[i];
+		if (arg == "--socket" && i+1<argc)
+			socket_path = argv[++i];
+		else if (arg == "--dictionary" && i+1<argc)
+			dictionaries.append( argv[++i] );
+		else if (arg == "--threads" && i+1<argc)
+			n_threads = QString( argv[++i] ).toInt();
+		else if (arg == "--compact")
+			options.compact_integral = true;
+		else if (arg == "--quantized")
+			quantized = true;
+		else if (arg == "--flat")
+			flat = true;
+		else if (arg == "--subsample" && i+1<argc)
+			options.subsample = QString( argv[++i] ).toInt();
+		else
+			args.append( arg );
+	}
+	if (args.count()<2){
+		qWarning( "Usage: %s [options] classifier_file [texton_file ...]", argv[0] );
+		qWarning( "     --socket p   : Listen on the unix socket p (default: stdin/stdout)" );
+		qWarning( "     --dictionary f: Texton dictionary for image requests (once per channel, in order)" );
+		qWarning( "     --threads n  : Number of worker threads (default: all cores)" );
+		qWarning( "     --compact    : Use a 16 bit integral histogram (less memory)" );
+		qWarning( "     --quantized  : classifier_file is a quantized model (see quantize)" );
+		qWarning( "     --flat       : classifier_file is a flat model (see flatten)" );
+		qWarning( "     --subsample s: Only evaluate every s'th pixel (0 = training subsample)" );
+		return 1;
+	}
+	if ((quantized || flat) && options.subsample != 1){
+		qWarning( "--subsample is not supported with %s", quantized ? "--quantized" : "--flat" );
+		return 1;
+	}
+#ifdef USE_TBB
+	tbb::task_scheduler_init init( n_threads > 0 ? n_threads : tbb::task_scheduler_init::automatic );
+#else
+	Q_UNUSED( n_threads );
+#endif
+	
+	// Load the dictionaries once, the image requests share them
+	Pipeline textonizer;
+	for( int i=0; i<dictionaries.count(); i++ )
+		if (!textonizer.addTexton( dictionaries[i] ))
+			return 1;
+	
+	// Keep the textons of the whole database resident
+	QMap< QString, Image<short> > textons;
+	if (args.count() > 2){
+		qDebug("(serve) Loading textons");
+		const QVector< QString > names = Dataset( ALL ).names();
+		QVector< Image<short> > tmp = loadTextonChannels( args.mid( 2 ), names );
+		for( int j=0; j<tmp.size(); j++ )
+			if (tmp[j].width() > 0)
+				textons[ names[j] ] = tmp[j];
+	}
+	
+	int listener = -1;
+	if (!socket_path.isEmpty()){
+		listener = listenUnix( socket_path );
+		if (listener < 0)
+			qFatal( "Failed to listen on '%s'", qPrintable( socket_path ) );
+		qDebug( "(serve) Listening on '%s'", qPrintable( socket_path ) );
+	}
+	signal( SIGINT, stop );
+	signal( SIGTERM, stop );
+	signal( SIGPIPE, SIG_IGN );
+	
+	bool ok = true;
+	if (flat){
+		FlatTextonBoost booster;
+		ok = booster.load( args[1] ) && serve( booster, textonizer, textons, listener, options );
+	}
+	else if (quantized){
+		QuantizedTextonBoost booster;
+		booster.load( args[1] );
+		ok = serve( booster, textonizer, textons, listener, options );
+	}
+	else{
+		TextonBoost booster;
+		booster.load( args[1] );
+		ok = serve( booster, textonizer, textons, listener, options );
+	}
+	if (listener >= 0){
+		close( listener );
+		unlink( QFile::encodeName( socket_path ).constData() );
+	}
+	return ok ? 0 : 1;
+}
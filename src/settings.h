@@ -50,6 +50,9 @@ static const char VOC2010_TEST_FILE  [] = "../data/voc/VOC2010/Test.txt";
 // VOC Cache
 static const char VOC2010_BBOX_DIRECTORY [] = "data/VOC2010_BBox/";
 
+// Decoded images and labels (built by cachedataset), used by loadImages if it exists
+static const char DATASET_CACHE [] = "data/dataset.cache";
+
 // Texton parameters
 static const int N_TEXTONS = 400;
 static const float FILTER_BANK_SIZE = 1.0;
@@ -29,6 +29,7 @@
 #include "util/colorconvertion.h"
 #include "util/labelimage.h"
 #include "util/util.h"
+#include "util/dataset.h"
 #include "feature/texton.h"
 #include "settings.h"
 #include <QVector>
@@ -38,11 +39,21 @@
 
 int main( int argc, char * argv[]){
 	/**** Read the IO ****/
-	if (argc<3){
-		qWarning( "Usage: %s classifier_file texton_file [texton_file ...]", argv[0] );
+	QVector< QString > args;
+	bool compact_integral = false;
+	for( int i=0; i<argc; i++ ){
+		QString arg = argv[i];
+		if (arg == "--compact")
+			compact_integral = true;
+		else
+			args.append( arg );
+	}
+	if (args.count()<3){
+		qWarning( "Usage: %s [--compact] classifier_file texton_file [texton_file ...]", argv[0] );
+		qWarning( "     --compact : Use 16 bit integral histograms (less memory)" );
 		return 1;
 	}
-	QString save_filename = argv[1];
+	QString save_filename = args[1];
 	int n_rounds = N_BOOSTING_ROUNDS;
 	int n_classifiers = N_CLASSIFIERS;
 	int n_thresholds = N_THRESHOLDS;
@@ -51,32 +62,23 @@ int main( int argc, char * argv[]){
 	int max_rect_size = MAX_RECT_SIZE;
 	
 	// Declare all variables we need for both training and evaluation
-	QVector< ColorImage > images;
-	QVector< LabelImage > labels;
 	QVector< Image<short> > textons;
-	QVector< QString > names;
 	
 	/**** Training ****/
-	qDebug("(train) Loading the database");
-	loadImages( images, labels, names, TRAIN );
-	images.clear();
+	qDebug("(train) Loading the labels");
+	Dataset dataset( TRAIN, Dataset::LABELS );
+	QVector< LabelImage > labels = dataset.labels();
+	const QVector< QString > & names = dataset.names();
 	// Color Conversion
 	qDebug("(train) Loading textons");
 	
-	int nTextons = argc-2;
-	for( int i=2; i<argc; i++ ){
-		QVector< Image<short> > tmp = loadTextons( argv[i], names );
-		for( int j=0; j<tmp.size(); j++ ){
-			if (j >= textons.count())
-				textons.append( Image<short>(tmp[j].width(), tmp[j].height(), nTextons) );
-			for( int k=0; k<tmp[j].width()*tmp[j].height(); k++ )
-				textons[j][k*nTextons+i-2] = tmp[j][k];
-		}
-	}
+	textons = loadTextonChannels( args.mid( 2 ), names );
+	// Stored by textonize (empty for old files)
+	const QVector< int > texton_counts = loadTextonCounts( args.mid( 2 ) );
 	
 	// Training
 	qDebug("(train) Boosting");
 	TextonBoost booster;
-	booster.train( textons, labels, n_rounds, n_classifiers, n_thresholds, subsample, min_rect_size, max_rect_size );
+	booster.train( textons, labels, n_rounds, n_classifiers, n_thresholds, subsample, min_rect_size, max_rect_size, compact_integral, texton_counts );
 	booster.save( save_filename );
 }
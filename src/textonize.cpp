@@ -29,96 +29,144 @@
 #include "util/colorconvertion.h"
 #include "util/labelimage.h"
 #include "util/util.h"
+#include "util/dataset.h"
 #include "feature/texton.h"
-#include "feature/filterbank.h"
-#include "feature/colorfeature.h"
 #include "settings.h"
 #include <QVector>
 #include <QString>
-#include "feature/locationfeature.h"
-#include "feature/hogfeature.h"
-#include "feature/bboxfeature.h"
+#include <QFileInfo>
+
+// Textonize images with an existing dictionary, either the given image
+// files or the whole database
+static int apply( const QString & dictionary_file, const QString & save_filename, QVector< QString > image_files ){
+	Texton texton;
+	if (!texton.load( dictionary_file ))
+		return 1;
+	
+	QVector< QString > names;
+	foreach( QString image_file, image_files )
+		names.append( QFileInfo( image_file ).completeBaseName() );
+	const Dataset dataset = image_files.isEmpty() ? Dataset( ALL, Dataset::IMAGES ) : Dataset( image_files, names, Dataset::IMAGES );
+	
+	qDebug("(apply) Textonizing %d images with '%s'", dataset.count(), qPrintable( texton.feature()->spec() ) );
+	return texton.textonizeFiles( save_filename, dataset ) ? 0 : 1;
+}
 
 
+// One texton channel to train
+struct FeatureJob{
+	QString spec, texton_file, dictionary_file;
+	int n_textons;
+};
+
 int main( int argc, char * argv[]){
 	/**** Read the IO ****/
-	if (argc<3){
-		qWarning( "Usage: %s texton_file type [params ..]", argv[0] );
+	QVector< QString > args;
+	QVector< FeatureJob > jobs;
+	QString dictionary_file, apply_file, combined_file;
+	for( int i=0; i<argc; i++ ){
+		QString arg = argv[i];
+		if (arg == "--feature" && i+3<argc){
+			FeatureJob job;
+			job.spec = argv[i+1];
+			job.n_textons = QString( argv[i+2] ).toInt();
+			job.texton_file = argv[i+3];
+			if (job.texton_file == "-")
+				job.texton_file = QString();
+			jobs.append( job );
+			i += 3;
+		}
+		else if (arg == "--dictionary" && i+1<argc){
+			// Belongs to the last --feature (if any)
+			if (jobs.isEmpty())
+				dictionary_file = argv[++i];
+			else
+				jobs.last().dictionary_file = argv[++i];
+		}
+		else if (arg == "--combined" && i+1<argc)
+			combined_file = argv[++i];
+		else if (arg == "--apply" && i+1<argc)
+			apply_file = argv[++i];
+		else
+			args.append( arg );
+	}
+	if (!apply_file.isEmpty() && args.count()>=2)
+		return apply( apply_file, args[1], args.mid( 2 ) );
+	if (args.count()>=3){
+		// Single feature: texton_file type [nTextons param]
+		FeatureJob job;
+		job.texton_file = args[1];
+		job.spec = args[2];
+		job.n_textons = args.count()>3 ? args[3].toInt() : N_TEXTONS;
+		if (args.count()>4)
+			job.spec += ":" + args[4];
+		job.dictionary_file = dictionary_file;
+		jobs.append( job );
+	}
+	if (jobs.isEmpty() || args.count() == 2){
+		qWarning( "Usage: %s [--dictionary file] texton_file type [params ..]", argv[0] );
+		qWarning( "       %s [--combined file] --feature spec n texton_file [--dictionary file] [--feature ..]", argv[0] );
+		qWarning( "       %s --apply file texton_file [image_file ..]", argv[0] );
 		qWarning( "     type :");
 		qWarning( "           FilterBank [nTextons filterbank_size]" );
 		qWarning( "           Color [nTextons]" );
 		qWarning( "           HoG [nTextons L/A/B]" );
 		qWarning( "           Location [nTextons]" );
 // 		qWarning( "           BBox [nTextons]" );
+		qWarning( "     --dictionary file : Save the trained texton dictionary" );
+		qWarning( "     --feature s n f   : Train n textons of feature spec s (e.g. filterbank:1.0, hog:a)" );
+		qWarning( "                         and save them to f (- for none), all features share one" );
+		qWarning( "                         pass over the images" );
+		qWarning( "     --combined file   : Save all features as one multi-channel texton file" );
+		qWarning( "     --apply file      : Textonize the images (default all) with a saved dictionary" );
 		return 1;
 	}
-	QString save_filename = argv[1];
-	QString type = argv[2];
-	type = type.toLower();
-	
-	int n_textons = N_TEXTONS;
-	if (argc>3)
-		n_textons = QString( argv[3] ).toInt();
 	
-	QSharedPointer<Feature> filter;
-	if (type == "filterbank"){
-		float filterbank_size = FILTER_BANK_SIZE;
-		
-		if (argc>4)
-			filterbank_size = QString( argv[4] ).toFloat();
-		
-		filter = QSharedPointer<Feature>( new FilterBank( filterbank_size ) );
+	QVector< QSharedPointer< Texton > > textons;
+	foreach( FeatureJob job, jobs ){
+		QSharedPointer<Feature> filter = createFeature( job.spec );
+		if (filter.isNull())
+			qFatal( "Unknown feature %s", qPrintable( job.spec ) );
+		textons.append( QSharedPointer< Texton >( new Texton( filter, job.n_textons ) ) );
 	}
-	else if (type == "color"){
-		filter = QSharedPointer<Feature>( new ColorFeature() );
-	}
-	else if (type == "location"){
-		filter = QSharedPointer<Feature>( new LocationFeature() );
-	}
-	else if (type == "hog"){
-		HogFeature::HogFeatureType type = HogFeature::L;
-		if (argc>4){
-			QString t = QString( argv[4] ).toLower();
-			if (t=="a") type = HogFeature::A;
-			if (t=="b") type = HogFeature::B;
-		}
-		filter = QSharedPointer<Feature>( new HogFeature(type) );
-	}
-	else if (type == "bbox"){
-		filter = QSharedPointer<Feature>( new BBoxFeature() );
-	}
-	else
-		qFatal( "Unknown feature %s", qPrintable( type ) );
 	// Declare all variables we need for both training and evaluation
 	QVector< ColorImage > images;
 	QVector< Image<float> > lab_images;
-	QVector< LabelImage > labels;
 	QVector< QString > names;
 	
 	/**** Training ****/
 	qDebug("(train) Loading the database");
-	loadImages( images, labels, names, TRAIN );
+	Dataset train( TRAIN, Dataset::IMAGES );
+	images = train.images();
+	names = train.names();
 	
 	// Color Conversion
 	qDebug("(train) Converting to Lab");
 	lab_images = RGBtoLab( images );
+	images.clear();
 	
-	// Training
-	qDebug("(train) Training Textons");
-	Texton texton( filter, n_textons );
-	texton.train( lab_images, names );
+	// Training (all features share the Lab images)
+	for( int k=0; k<textons.count(); k++ ){
+		qDebug("(train) Training Textons '%s'", qPrintable( textons[k]->feature()->spec() ) );
+		textons[k]->train( lab_images, names );
+		if (!jobs[k].dictionary_file.isEmpty())
+			textons[k]->save( jobs[k].dictionary_file );
+	}
+	lab_images.clear();
 	
 	
 	/**** Evaluation ****/
-	qDebug("(test)  Loading the database");
-	loadImages( images, labels, names, ALL );
-	// Color Conversion
-	qDebug("(test)  Converting to Lab");
-	lab_images = RGBtoLab( images );
-	// Evalutation
+	// Stream the images through load (or the dataset cache), Lab conversion
+	// and textonization (all features at once) straight into the texton files
 	qDebug("(test)  Textonizing");
-	QVector< Image<short> > textons = texton.textonize( lab_images, names );
-	
-	/**** Storing textons ****/
-	saveTextons( save_filename, textons, names );
+	const Dataset all( ALL, Dataset::IMAGES );
+	QVector< const Texton * > texton_ptrs;
+	QVector< QString > texton_files;
+	for( int k=0; k<textons.count(); k++ ){
+		texton_ptrs.append( textons[k].data() );
+		texton_files.append( jobs[k].texton_file );
+	}
+	if (!textonizeFiles( texton_ptrs, texton_files, combined_file, all ))
+		return 1;
+	return 0;
 }
@@ -29,6 +29,7 @@
 #include "util/colorconvertion.h"
 #include "util/labelimage.h"
 #include "util/util.h"
+#include "util/dataset.h"
 #include "feature/texton.h"
 #include "settings.h"
 #include <QVector>
@@ -44,15 +45,12 @@ int main( int argc, char * argv[]){
 		return 1;
 	}
 	// Declare all variables we need for both training and evaluation
-	QVector< ColorImage > images;
-	QVector< LabelImage > labels;
 	QVector< QVector< Image<short> > > textons;
-	QVector< QString > names;
 	
 	/**** Training ****/
-	qDebug("(train) Loading the database");
-	loadImages( images, labels, names, TEST );
-	// Color Conversion
+	// Only the images that are shown are decoded
+	Dataset dataset( TEST, Dataset::IMAGES );
+	QVector< QString > names = dataset.names().mid( 0, 10 );
 	qDebug("(train) Loading textons");
 	
 	for ( int k=1; k<argc; k++ )
@@ -64,14 +62,17 @@ int main( int argc, char * argv[]){
 	QVector< QRgb > colors;
 	for( int i=0; i<5000; i++ )
 		colors.append( qRgb(random()&0xff,random()&0xff,random()&0xff) );
-	for( int k=0; k<images.count() && k<10; k++ ){
+	for( int k=0; k<names.count(); k++ ){
+		ColorImage image;
+		LabelImage labels;
+		dataset.load( k, image, labels );
 		QLabel * lim = new QLabel;
-		lim->setPixmap( QPixmap::fromImage(images[k]) );
+		lim->setPixmap( QPixmap::fromImage(image) );
 		layout->addWidget(lim, k, 0 );
 		
 		for ( int l=0; l<textons.count(); l++ ){
 			QLabel * ltx = new QLabel;
-			QImage tx = images[k];
+			QImage tx = image;
 			for( int j=0; j<tx.height(); j++ )
 				for( int i=0; i<tx.width(); i++ )
 					tx.setPixel(i,j,colors[textons[l][k](i,j)]);
@@ -28,66 +28,118 @@
 #include "colorconvertion.h"
 #include "image.h"
 #include "colorimage.h"
+#include "config.h"
 #include <QVector>
 #include <cmath>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#ifdef USE_TBB
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+#endif
+
+// Contribution of every 8 bit value of every channel to X, Y and Z, so
+// converting to XYZ takes 9 lookups and 6 additions
+struct XYZTable{
+	float X[3][256], Y[3][256], Z[3][256];
+	XYZTable(){
+		const double M[3][3] = {{0.412453, 0.357580, 0.180423},
+		                        {0.212671, 0.715160, 0.072169},
+		                        {0.019334, 0.119193, 0.950227}};
+		for( int c=0; c<3; c++ )
+			for( int v=0; v<256; v++ ){
+				X[c][v] = M[0][c] * v / 255.0;
+				Y[c][v] = M[1][c] * v / 255.0;
+				Z[c][v] = M[2][c] * v / 255.0;
+			}
+	}
+};
+static const XYZTable XYZ_TABLE;
+
+// XYZ of 4 pixels (the ones past n are black)
+static inline void toXYZ( const Color * c, int n, float * X, float * Y, float * Z ){
+	for( int k=0; k<4; k++ )
+		if (k < n){
+			X[k] = XYZ_TABLE.X[0][c[k].r] + XYZ_TABLE.X[1][c[k].g] + XYZ_TABLE.X[2][c[k].b];
+			Y[k] = XYZ_TABLE.Y[0][c[k].r] + XYZ_TABLE.Y[1][c[k].g] + XYZ_TABLE.Y[2][c[k].b];
+			Z[k] = XYZ_TABLE.Z[0][c[k].r] + XYZ_TABLE.Z[1][c[k].g] + XYZ_TABLE.Z[2][c[k].b];
+		}
+		else
+			X[k] = Y[k] = Z[k] = 0;
+}
+
+// Cube roots (of values > 0.008856) from an exponent guess and three Newton
+// steps, the relative error is below 1e-6
+#ifdef __SSE2__
+static inline __m128 cbrt_ps( __m128 x ){
+	__m128i i = _mm_cvttps_epi32( _mm_mul_ps( _mm_cvtepi32_ps( _mm_castps_si128( x ) ), _mm_set1_ps( 1.f/3.f ) ) );
+	__m128 y = _mm_castsi128_ps( _mm_add_epi32( i, _mm_set1_epi32( 709921077 ) ) );
+	const __m128 third = _mm_set1_ps( 1.f/3.f );
+	for( int it=0; it<3; it++ )
+		y = _mm_mul_ps( third, _mm_add_ps( _mm_add_ps( y, y ), _mm_div_ps( x, _mm_mul_ps( y, y ) ) ) );
+	return y;
+}
+static inline __m128 select_ps( __m128 mask, __m128 a, __m128 b ){
+	return _mm_or_ps( _mm_and_ps( mask, a ), _mm_andnot_ps( mask, b ) );
+}
+#else
+static inline float cbrtf_fast( float x ){
+	union{ float f; int i; } u;
+	u.f = x;
+	u.i = (int)(u.i * (1.f/3.f)) + 709921077;
+	float y = u.f;
+	for( int it=0; it<3; it++ )
+		y = (1.f/3.f) * (y + y + x / (y*y));
+	return y;
+}
+#endif
 
 Image< float > RGBtoLab ( const ColorImage& cim )
 {
 	Image<float> r( cim.width(), cim.height(), 3 );
 	// See http://en.wikipedia.org/wiki/Lab_color_space
-	const double Xn = 0.950456, Yn = 1.000, Zn = 1.088854;
-	const double t=0.008856;
-	for( int j=0; j<cim.height(); j++ )
-		for( int i=0; i<cim.width(); i++ ){
-			// Load RGB
-			double R = cim(i,j).r / 255.0;
-			double G = cim(i,j).g / 255.0;
-			double B = cim(i,j).b / 255.0;
-			
-			// Convert to XYZ
-			double X =  0.412453 * R + 0.357580 * G + 0.180423 * B;
-			double Y =  0.212671 * R + 0.715160 * G + 0.072169 * B;
-			double Z =  0.019334 * R + 0.119193 * G + 0.950227 * B;
-			
-			// Conver to Lab
-			double L,a,b;
-			double x = X / Xn, y = Y / Yn, z = Z / Zn;
-			if ( y > t )
-				L = 116 * pow( y, 1.0 / 3.0 ) - 16.0;
-			else
-				L = 903.3 * y;
-			
-			// Compute f(t)
-			if ( x > t )
-				x = pow( x, 1.0 / 3.0 );
-			else
-				x = 7.787037 * x - 0.137931;
-			
-			if ( y > t )
-				y = pow( y, 1.0 / 3.0 );
-			else
-				y = 7.787037 * y - 0.137931;
-			
-			if ( z > t )
-				z = pow( z, 1.0 / 3.0 );
-			else
-				z = 7.787037 * z - 0.137931;
-			
-			a = 500.0*( x - y );
-			b = 200.0*( y - z );
-			
-			// Store the value
-			r(i,j,0) = L;
-			r(i,j,1) = a;
-			r(i,j,2) = b;
+	const float Xn = 0.950456, Yn = 1.000, Zn = 1.088854;
+	const float t=0.008856;
+	const int N = cim.width()*cim.height();
+	const Color * c = cim.data();
+	float * o = r.data();
+	float X[4], Y[4], Z[4], L[4], a[4], b[4];
+	for( int i=0; i<N; i+=4 ){
+		toXYZ( c+i, N-i, X, Y, Z );
+#ifdef __SSE2__
+		const __m128 T = _mm_set1_ps( t ), k = _mm_set1_ps( 7.787037f ), d = _mm_set1_ps( 0.137931f );
+		__m128 x = _mm_mul_ps( _mm_loadu_ps( X ), _mm_set1_ps( 1.f/Xn ) );
+		__m128 y = _mm_mul_ps( _mm_loadu_ps( Y ), _mm_set1_ps( 1.f/Yn ) );
+		__m128 z = _mm_mul_ps( _mm_loadu_ps( Z ), _mm_set1_ps( 1.f/Zn ) );
+		__m128 my = _mm_cmpgt_ps( y, T );
+		// f(t)
+		__m128 fx = select_ps( _mm_cmpgt_ps( x, T ), cbrt_ps( x ), _mm_sub_ps( _mm_mul_ps( k, x ), d ) );
+		__m128 fy = select_ps( my, cbrt_ps( y ), _mm_sub_ps( _mm_mul_ps( k, y ), d ) );
+		__m128 fz = select_ps( _mm_cmpgt_ps( z, T ), cbrt_ps( z ), _mm_sub_ps( _mm_mul_ps( k, z ), d ) );
+		// L = 116 f(y) - 16 above the threshold
+		_mm_storeu_ps( L, select_ps( my, _mm_sub_ps( _mm_mul_ps( _mm_set1_ps( 116.f ), fy ), _mm_set1_ps( 16.f ) ), _mm_mul_ps( _mm_set1_ps( 903.3f ), y ) ) );
+		_mm_storeu_ps( a, _mm_mul_ps( _mm_set1_ps( 500.f ), _mm_sub_ps( fx, fy ) ) );
+		_mm_storeu_ps( b, _mm_mul_ps( _mm_set1_ps( 200.f ), _mm_sub_ps( fy, fz ) ) );
+#else
+		for( int k=0; k<4; k++ ){
+			float x = X[k] / Xn, y = Y[k] / Yn, z = Z[k] / Zn;
+			float fx = x > t ? cbrtf_fast( x ) : 7.787037f * x - 0.137931f;
+			float fy = y > t ? cbrtf_fast( y ) : 7.787037f * y - 0.137931f;
+			float fz = z > t ? cbrtf_fast( z ) : 7.787037f * z - 0.137931f;
+			L[k] = y > t ? 116 * fy - 16 : 903.3f * y;
+			a[k] = 500*( fx - fy );
+			b[k] = 200*( fy - fz );
 		}
-	return r;
-}
-QVector< Image< float > > RGBtoLab ( const QVector< ColorImage >& cim )
-{
-	QVector< Image< float > > r;
-	for( int i=0; i<cim.size(); i++ )
-		r.append( RGBtoLab( cim[i] ) );
+#endif
+		// Store the value
+		for( int k=0; k<4 && i+k<N; k++ ){
+			o[3*(i+k)+0] = L[k];
+			o[3*(i+k)+1] = a[k];
+			o[3*(i+k)+2] = b[k];
+		}
+	}
 	return r;
 }
 
@@ -95,39 +147,76 @@ Image< float > RGBtoLuv ( const ColorImage& cim )
 {
 	Image<float> r( cim.width(), cim.height(), 3 );
 	// See http://en.wikipedia.org/wiki/Luv_color_space
-	const double Yn = 1.000, ur = 0.19783303699678276, vr = 0.46833047435252234;
-	const double t=0.008856;
-	for( int j=0; j<cim.height(); j++ )
-		for( int i=0; i<cim.width(); i++ ){
-			// Load RGB
-			double R = cim(i,j).r / 255.0;
-			double G = cim(i,j).g / 255.0;
-			double B = cim(i,j).b / 255.0;
-			
-			// Convert to XYZ
-			double X =  0.412453 * R + 0.357580 * G + 0.180423 * B;
-			double Y =  0.212671 * R + 0.715160 * G + 0.072169 * B;
-			double Z =  0.019334 * R + 0.119193 * G + 0.950227 * B;
-			
-			// Conver to Luv
-			double L;
-			double uu = 4*X / (X+15*Y+3*Z), vv = 9*Y / (X+15*Y+3*Z), y = Y / Yn;
-			if ( y > t )
-				L = 116 * pow( y, 1.0 / 3.0 ) - 16.0;
-			else
-				L = 903.3 * y;
-			
-			// Store the value
-			r(i,j,0) = L;
-			r(i,j,1) = 13*L*(uu-ur);
-			r(i,j,2) = 13*L*(vv-vr);
+	const float Yn = 1.000, ur = 0.19783303699678276, vr = 0.46833047435252234;
+	const float t=0.008856;
+	const int N = cim.width()*cim.height();
+	const Color * c = cim.data();
+	float * o = r.data();
+	float X[4], Y[4], Z[4], L[4], u[4], v[4];
+	for( int i=0; i<N; i+=4 ){
+		toXYZ( c+i, N-i, X, Y, Z );
+#ifdef __SSE2__
+		__m128 x = _mm_loadu_ps( X ), y = _mm_loadu_ps( Y ), z = _mm_loadu_ps( Z );
+		__m128 yn = _mm_mul_ps( y, _mm_set1_ps( 1.f/Yn ) );
+		__m128 l = select_ps( _mm_cmpgt_ps( yn, _mm_set1_ps( t ) ), _mm_sub_ps( _mm_mul_ps( _mm_set1_ps( 116.f ), cbrt_ps( yn ) ), _mm_set1_ps( 16.f ) ), _mm_mul_ps( _mm_set1_ps( 903.3f ), yn ) );
+		// u' and v' are undefined for black (L is 0 there, so is the result)
+		__m128 s = _mm_add_ps( x, _mm_add_ps( _mm_mul_ps( _mm_set1_ps( 15.f ), y ), _mm_mul_ps( _mm_set1_ps( 3.f ), z ) ) );
+		__m128 black = _mm_cmpeq_ps( s, _mm_setzero_ps() );
+		__m128 is = _mm_andnot_ps( black, _mm_div_ps( _mm_set1_ps( 1.f ), select_ps( black, _mm_set1_ps( 1.f ), s ) ) );
+		__m128 uu = _mm_mul_ps( _mm_mul_ps( _mm_set1_ps( 4.f ), x ), is );
+		__m128 vv = _mm_mul_ps( _mm_mul_ps( _mm_set1_ps( 9.f ), y ), is );
+		__m128 l13 = _mm_mul_ps( _mm_set1_ps( 13.f ), l );
+		_mm_storeu_ps( L, l );
+		_mm_storeu_ps( u, _mm_andnot_ps( black, _mm_mul_ps( l13, _mm_sub_ps( uu, _mm_set1_ps( ur ) ) ) ) );
+		_mm_storeu_ps( v, _mm_andnot_ps( black, _mm_mul_ps( l13, _mm_sub_ps( vv, _mm_set1_ps( vr ) ) ) ) );
+#else
+		for( int k=0; k<4; k++ ){
+			float y = Y[k] / Yn, s = X[k] + 15*Y[k] + 3*Z[k];
+			L[k] = y > t ? 116 * cbrtf_fast( y ) - 16 : 903.3f * y;
+			// u' and v' are undefined for black (L is 0 there, so is the result)
+			u[k] = s > 0 ? 13*L[k]*(4*X[k] / s - ur) : 0;
+			v[k] = s > 0 ? 13*L[k]*(9*Y[k] / s - vr) : 0;
+		}
+#endif
+		// Store the value
+		for( int k=0; k<4 && i+k<N; k++ ){
+			o[3*(i+k)+0] = L[k];
+			o[3*(i+k)+1] = u[k];
+			o[3*(i+k)+2] = v[k];
 		}
+	}
 	return r;
 }
-QVector< Image< float > > RGBtoLuv ( const QVector< ColorImage >& cim )
-{
-	QVector< Image< float > > r;
+
+#ifdef USE_TBB
+class TBBConvertColor{
+	Image< float > (*convert)( const ColorImage & );
+	const ColorImage * cim;
+	Image< float > * r;
+public:
+	TBBConvertColor( Image< float > (*convert)( const ColorImage & ), const ColorImage * cim, Image< float > * r ):convert(convert),cim(cim),r(r){}
+	void operator()( const tbb::blocked_range<int> & rng ) const{
+		for( int i=rng.begin(); i<rng.end(); i++ )
+			r[i] = convert( cim[i] );
+	}
+};
+#endif
+// Convert all images in parallel
+static QVector< Image< float > > convertAll( Image< float > (*convert)( const ColorImage & ), const QVector< ColorImage >& cim ){
+	QVector< Image< float > > r( cim.size() );
+#ifdef USE_TBB
+	tbb::parallel_for( tbb::blocked_range<int>( 0, cim.size(), 1 ), TBBConvertColor( convert, cim.data(), r.data() ) );
+#else
 	for( int i=0; i<cim.size(); i++ )
-		r.append( RGBtoLuv( cim[i] ) );
+		r[i] = convert( cim[i] );
+#endif
 	return r;
 }
+QVector< Image< float > > RGBtoLab ( const QVector< ColorImage >& cim )
+{
+	return convertAll( RGBtoLab, cim );
+}
+QVector< Image< float > > RGBtoLuv ( const QVector< ColorImage >& cim )
+{
+	return convertAll( RGBtoLuv, cim );
+}
@@ -27,7 +27,12 @@
 
 #include "colorimage.h"
 #include <QImage>
+#include <QVector>
 #include <cmath>
+#include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 /**************************/
 /***       Color        ***/
@@ -151,25 +156,63 @@ float ColorF::length() const {
 /**************************/
 ColorImage::ColorImage( int w, int h ): InterpolableImage<Color>(w, h){
 }
+// QRgb 0xAARRGGBB <-> Color 0xAABBGGRR
+static inline unsigned int swapRB( unsigned int p ){
+	return (p & 0xff00ff00) | ((p & 0xff) << 16) | ((p >> 16) & 0xff);
+}
+static void copyPixels( unsigned int * dst, const unsigned int * src, int n, bool swap ){
+	if (!swap){
+		memcpy( dst, src, n*sizeof(unsigned int) );
+		return;
+	}
+	int i=0;
+#ifdef __SSE2__
+	const __m128i ag = _mm_set1_epi32( 0xff00ff00 ), b = _mm_set1_epi32( 0xff );
+	for( ; i+4<=n; i+=4 ){
+		__m128i p = _mm_loadu_si128( (const __m128i*)(src+i) );
+		__m128i rb = _mm_or_si128( _mm_slli_epi32( _mm_and_si128( p, b ), 16 ), _mm_and_si128( _mm_srli_epi32( p, 16 ), b ) );
+		_mm_storeu_si128( (__m128i*)(dst+i), _mm_or_si128( _mm_and_si128( p, ag ), rb ) );
+	}
+#endif
+	for( ; i<n; i++ )
+		dst[i] = swapRB( src[i] );
+}
+// Copy the pixels of qim (as qim.pixel returns them) row by row
+static void fromQImage( const QImage & qim, Color * data, bool swap ){
+	const int W = qim.width(), H = qim.height();
+	if (qim.format() == QImage::Format_Indexed8){
+		const QVector< QRgb > colors = qim.colorTable();
+		unsigned int table[256];
+		for( int k=0; k<256; k++ )
+			table[k] = k < colors.count() ? (swap ? swapRB( colors[k] ) : colors[k]) : 0;
+		for( int j=0; j<H; j++ ){
+			const uchar * line = qim.scanLine( j );
+			for( int i=0; i<W; i++ )
+				data[j*W+i] = table[ line[i] ];
+		}
+	}
+	// Premultiplied pixels go through the conversion, pixel() returns them
+	// un-premultiplied
+	else if (qim.format() == QImage::Format_RGB32 || qim.format() == QImage::Format_ARGB32){
+		for( int j=0; j<H; j++ )
+			copyPixels( (unsigned int*)(data+j*W), (const unsigned int*)qim.scanLine( j ), W, swap );
+	}
+	else
+		fromQImage( qim.convertToFormat( QImage::Format_ARGB32 ), data, swap );
+}
 ColorImage::ColorImage(const QImage& qim) : InterpolableImage< Color >( qim.width(), qim.height() ) {
-	for( int j=0; j<height_; j++ )
-		for( int i=0; i<width_; i++ )
-			operator()(i,j) = qim.pixel( i, j );
+	fromQImage( qim, data_, false );
 }
 ColorImage& ColorImage::operator=(const QImage& qim) {
-	QImage im = qim.rgbSwapped();
-	init( im.width(), im.height() );
-	for( int j=0; j<height_; j++ )
-		for( int i=0; i<width_; i++ )
-			operator()(i,j) = im.pixel( i, j );
+	init( qim.width(), qim.height() );
+	fromQImage( qim, data_, true );
 	return *this;
 }
 ColorImage::operator QImage() const {
 	QImage r( width_, height_, QImage::Format_ARGB32 );
 	for( int j=0; j<height_; j++ )
-		for( int i=0; i<width_; i++ )
-			r.setPixel( i, j, operator()(i,j) );
-	return r.rgbSwapped();
+		copyPixels( (unsigned int*)r.scanLine( j ), (const unsigned int*)(data_+j*width_), width_, true );
+	return r;
 }
 
 QDataStream & operator<<( QDataStream & s, const ColorImage & im ){
@@ -80,6 +80,7 @@ class ColorImage : public InterpolableImage< Color > {
 	friend QDataStream & operator>>( QDataStream & s, ColorImage & im );
 public:
 	explicit ColorImage( int w=0, int h=0 );
+	// Keeps the QRgb value of every pixel (r and b swapped)
 	ColorImage( const QImage & qim );
 	ColorImage& operator=( const QImage & qim );
 	operator QImage() const;
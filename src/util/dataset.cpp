@@ -0,0 +1,225 @@
+/*
+    Copyright (c) 2011, Philipp Krähenbühl
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+        * Neither the name of the Stanford University nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY Philipp Krähenbühl ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL Philipp Krähenbühl BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "dataset.h"
+#include "datasetcache.h"
+#include "util.h"
+#include "settings.h"
+#include "config.h"
+#include <QFile>
+
+#ifdef USE_TBB
+#include <tbb/task_scheduler_init.h>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+#include <tbb/pipeline.h>
+#endif
+
+#ifdef USE_MSRC
+static const LabelType LABEL_TYPE = MSRC;
+#else
+static const LabelType LABEL_TYPE = VOC2010;
+#endif
+
+static QString labelFileOf( QString image_file ){
+#ifdef USE_MSRC
+	return image_file.replace(".bmp", "_GT.bmp");
+#else
+	return image_file.replace("/PNGImages/", "/SegmentationClass/");
+#endif
+}
+
+// The dataset cache is opened once per process (if it exists)
+static const DatasetCache * datasetCache(){
+	static DatasetCache * cache = NULL;
+	static bool opened = false;
+	if (!opened){
+		opened = true;
+		if (QFile::exists( DATASET_CACHE )){
+			cache = new DatasetCache;
+			if (!cache->open( DATASET_CACHE )){
+				delete cache;
+				cache = NULL;
+			}
+		}
+	}
+	return cache;
+}
+
+Dataset::Dataset( int type, int parts, bool use_cache ):parts_(parts),cache_(NULL) {
+	listImages( image_files_, names_, type );
+	foreach (QString image_file, image_files_ )
+		label_files_.append( labelFileOf( image_file ) );
+	if (use_cache)
+		cache_ = datasetCache();
+}
+Dataset::Dataset( const QVector< QString > & image_files, const QVector< QString > & names, int parts, bool use_cache ):image_files_(image_files),names_(names),parts_(parts),cache_(NULL) {
+	foreach (QString image_file, image_files_ )
+		label_files_.append( labelFileOf( image_file ) );
+	if (use_cache)
+		cache_ = datasetCache();
+}
+int Dataset::count() const {
+	return names_.count();
+}
+const QVector< QString >& Dataset::names() const {
+	return names_;
+}
+const QString& Dataset::name( int i ) const {
+	return names_[i];
+}
+const QString& Dataset::imageFile( int i ) const {
+	return image_files_[i];
+}
+const QString& Dataset::labelFile( int i ) const {
+	return label_files_[i];
+}
+void Dataset::load( int i, ColorImage& image, LabelImage& labels ) const {
+	// Cached images are views into the cache, everything else (and images
+	// whose file changed) is decoded
+	if (parts_ & IMAGES)
+		if (!cache_ || !cache_->image( names_[i], image_files_[i], image ))
+			image.load( image_files_[i] );
+	if (parts_ & LABELS)
+		if (!cache_ || !cache_->labels( names_[i], label_files_[i], labels ))
+			labels.load( label_files_[i], LABEL_TYPE );
+}
+
+#ifdef USE_TBB
+class TBBLoadDataset{
+	const Dataset & dataset;
+	ColorImage * images;
+	LabelImage * labels;
+public:
+	TBBLoadDataset( const Dataset & dataset, ColorImage * images, LabelImage * labels ):dataset(dataset),images(images),labels(labels){}
+	void operator()( const tbb::blocked_range<int> & rng ) const{
+		ColorImage image;
+		LabelImage label;
+		for( int i=rng.begin(); i<rng.end(); i++ ){
+			dataset.load( i, images ? images[i] : image, labels ? labels[i] : label );
+		}
+	}
+};
+#endif
+QVector< ColorImage > Dataset::images() const {
+	QVector< ColorImage > r( count() );
+	if (!(parts_ & IMAGES) || !count())
+		return r;
+	Dataset images_only( *this );
+	images_only.parts_ = IMAGES;
+#ifdef USE_TBB
+	tbb::parallel_for( tbb::blocked_range<int>( 0, count(), 1 ), TBBLoadDataset( images_only, r.data(), NULL ) );
+#else
+	LabelImage labels;
+	for( int i=0; i<count(); i++ )
+		images_only.load( i, r[i], labels );
+#endif
+	return r;
+}
+QVector< LabelImage > Dataset::labels() const {
+	QVector< LabelImage > r( count() );
+	if (!(parts_ & LABELS) || !count())
+		return r;
+	Dataset labels_only( *this );
+	labels_only.parts_ = LABELS;
+#ifdef USE_TBB
+	tbb::parallel_for( tbb::blocked_range<int>( 0, count(), 1 ), TBBLoadDataset( labels_only, NULL, r.data() ) );
+#else
+	ColorImage image;
+	for( int i=0; i<count(); i++ )
+		labels_only.load( i, image, r[i] );
+#endif
+	return r;
+}
+
+#ifdef USE_TBB
+struct DatasetItem{
+	int id;
+	ColorImage image;
+	LabelImage labels;
+};
+class TBBDatasetIndex: public tbb::filter{
+	int n, count;
+public:
+	TBBDatasetIndex( int count ):tbb::filter( tbb::filter::serial_in_order ),n(0),count(count){}
+	void * operator()( void * ){
+		if (n >= count)
+			return NULL;
+		DatasetItem * item = new DatasetItem;
+		item->id = n++;
+		return item;
+	}
+};
+class TBBDatasetLoad: public tbb::filter{
+	const Dataset & dataset;
+	Dataset::Consumer & consumer;
+public:
+	TBBDatasetLoad( const Dataset & dataset, Dataset::Consumer & consumer ):tbb::filter( tbb::filter::parallel ),dataset(dataset),consumer(consumer){}
+	void * operator()( void * p ){
+		DatasetItem * item = (DatasetItem*)p;
+		dataset.load( item->id, item->image, item->labels );
+		consumer.prepare( item->id, item->image, item->labels );
+		return item;
+	}
+};
+class TBBDatasetConsume: public tbb::filter{
+	Dataset::Consumer & consumer;
+public:
+	TBBDatasetConsume( Dataset::Consumer & consumer ):tbb::filter( tbb::filter::serial_in_order ),consumer(consumer){}
+	void * operator()( void * p ){
+		DatasetItem * item = (DatasetItem*)p;
+		consumer( item->id, item->image, item->labels );
+		delete item;
+		return NULL;
+	}
+};
+#endif
+void Dataset::process( Consumer& consumer, int prefetch ) const {
+#ifdef USE_TBB
+	if (prefetch <= 0)
+		prefetch = 4*tbb::task_scheduler_init::default_num_threads();
+	TBBDatasetIndex index( count() );
+	TBBDatasetLoad load( *this, consumer );
+	TBBDatasetConsume consume( consumer );
+	tbb::pipeline pipeline;
+	pipeline.add_filter( index );
+	pipeline.add_filter( load );
+	pipeline.add_filter( consume );
+	// Every image in flight holds a token, so prefetch bounds the memory
+	pipeline.run( prefetch );
+	pipeline.clear();
+#else
+	for( int i=0; i<count(); i++ ){
+		ColorImage image;
+		LabelImage labels;
+		load( i, image, labels );
+		consumer.prepare( i, image, labels );
+		consumer( i, image, labels );
+	}
+#endif
+}
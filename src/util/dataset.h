@@ -0,0 +1,79 @@
+/*
+    Copyright (c) 2011, Philipp Krähenbühl
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+        * Neither the name of the Stanford University nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY Philipp Krähenbühl ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL Philipp Krähenbühl BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#pragma once
+
+#include "colorimage.h"
+#include "labelimage.h"
+#include <QVector>
+#include <QString>
+
+class DatasetCache;
+
+// The images of a split (see DataType). The names are listed up front, the
+// images are only decoded when asked for (views into the dataset cache if it
+// contains them).
+class Dataset{
+public:
+	enum Parts{
+		IMAGES=1,
+		LABELS=2,
+		IMAGES_AND_LABELS=3
+	};
+	// Receives the images of process one at a time, in order
+	class Consumer{
+	public:
+		virtual ~Consumer(){}
+		// Called right after image i was decoded, for several images in
+		// parallel (before operator() gets image i)
+		virtual void prepare( int i, const ColorImage & image, const LabelImage & labels ){}
+		virtual void operator()( int i, const ColorImage & image, const LabelImage & labels ) = 0;
+	};
+protected:
+	QVector< QString > image_files_, label_files_, names_;
+	int parts_;
+	const DatasetCache * cache_;
+public:
+	// Only the given parts are loaded (the others stay empty)
+	Dataset( int type, int parts = IMAGES_AND_LABELS, bool use_cache = true );
+	// Some image files (not necessarily part of a split)
+	Dataset( const QVector< QString > & image_files, const QVector< QString > & names, int parts = IMAGES_AND_LABELS, bool use_cache = true );
+	int count() const;
+	const QVector< QString > & names() const;
+	const QString & name( int i ) const;
+	const QString & imageFile( int i ) const;
+	const QString & labelFile( int i ) const;
+	// Decode image i
+	void load( int i, ColorImage & image, LabelImage & labels ) const;
+	// Decode all images (or labels) in parallel
+	QVector< ColorImage > images() const;
+	QVector< LabelImage > labels() const;
+	// Decode the images in parallel, at most prefetch images ahead of the
+	// consumer (0 = 4 per thread)
+	void process( Consumer & consumer, int prefetch = 0 ) const;
+};
@@ -0,0 +1,191 @@
+/*
+    Copyright (c) 2011, Philipp Krähenbühl
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+        * Neither the name of the Stanford University nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY Philipp Krähenbühl ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL Philipp Krähenbühl BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "datasetcache.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QDataStream>
+#include <sys/mman.h>
+
+static const quint32 CACHE_MAGIC = 0x54624443; // "TbDC"
+static const quint32 CACHE_VERSION = 2;
+// Index offset, version and magic
+static const int FOOTER_SIZE = 16;
+
+QDataStream & operator<<( QDataStream & s, const DatasetCache::Entry & e ){
+	return s << e.width << e.height << e.image_offset << e.label_offset << e.image_size << e.image_mtime << e.label_size << e.label_mtime;
+}
+QDataStream & operator>>( QDataStream & s, DatasetCache::Entry & e ){
+	return s >> e.width >> e.height >> e.image_offset >> e.label_offset >> e.image_size >> e.image_mtime >> e.label_size >> e.label_mtime;
+}
+// Size and modification time of a file (-1 if it doesn't exist)
+static void stamp( const QString & filename, qint64 & size, qint64 & mtime ){
+	QFileInfo info( filename );
+	size = info.exists() ? info.size() : -1;
+	mtime = info.exists() ? (qint64)info.lastModified().toTime_t() : -1;
+}
+static bool unchanged( const QString & filename, qint64 size, qint64 mtime ){
+	qint64 s, t;
+	stamp( filename, s, t );
+	return s == size && t == mtime;
+}
+
+// Does an aligned block of n elements at offset (plus the 16 bytes the SSE
+// copy of Image may read past it's end) lie within a file of the given size
+static bool fits( qint64 offset, qint64 n, qint64 element_size, qint64 size ){
+	return offset >= 0 && offset % 16 == 0 && n >= 0 && n <= size / element_size && offset <= size - n*element_size - 16;
+}
+
+DatasetCache::DatasetCache():map_(NULL),size_(0) {
+}
+DatasetCache::~DatasetCache() {
+	close();
+}
+bool DatasetCache::open(const QString& filename) {
+	close();
+	QFile file( filename );
+	if (!file.open( QFile::ReadOnly ) || file.size() < FOOTER_SIZE){
+		qWarning( "Failed to open the dataset cache '%s'", qPrintable( filename ) );
+		return false;
+	}
+	QDataStream s( &file );
+	file.seek( file.size() - FOOTER_SIZE );
+	qint64 index_offset;
+	quint32 version, magic;
+	s >> index_offset >> version >> magic;
+	if (magic != CACHE_MAGIC || version != CACHE_VERSION || index_offset < 0 || index_offset >= file.size()){
+		qWarning( "'%s' is not a dataset cache", qPrintable( filename ) );
+		return false;
+	}
+	file.seek( index_offset );
+	s >> index_;
+	bool valid = s.status() == QDataStream::Ok;
+	foreach( const Entry & e, index_ ){
+		const qint64 n = (qint64)e.width*e.height;
+		valid = valid && e.width >= 0 && e.height >= 0 && fits( e.image_offset, n, sizeof(Color), file.size() ) && (e.label_offset == -1 || fits( e.label_offset, n, 1, file.size() ));
+	}
+	if (!valid){
+		qWarning( "Corrupt dataset cache '%s'", qPrintable( filename ) );
+		index_.clear();
+		return false;
+	}
+	// Private mapping (QFile::map can't do that in Qt4): pages are shared until
+	// someone writes to an image
+	size_ = file.size();
+	void * map = mmap( NULL, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE, file.handle(), 0 );
+	if (map == MAP_FAILED){
+		qWarning( "Failed to map the dataset cache '%s'", qPrintable( filename ) );
+		index_.clear();
+		size_ = 0;
+		return false;
+	}
+	map_ = (uchar*)map;
+	return true;
+}
+void DatasetCache::close() {
+	if (map_)
+		munmap( map_, size_ );
+	map_ = NULL;
+	size_ = 0;
+	index_.clear();
+}
+bool DatasetCache::isOpen() const {
+	return map_ != NULL;
+}
+bool DatasetCache::contains(const QString& name) const {
+	return index_.contains( name );
+}
+bool DatasetCache::image(const QString& name, const QString& image_file, ColorImage& r) const {
+	if (!index_.contains( name ))
+		return false;
+	const Entry e = index_.value( name );
+	if (!unchanged( image_file, e.image_size, e.image_mtime ))
+		return false;
+	r.setView( (Color*)(map_ + e.image_offset), e.width, e.height );
+	return true;
+}
+bool DatasetCache::labels(const QString& name, const QString& label_file, LabelImage& r) const {
+	if (!index_.contains( name ) || index_.value( name ).label_offset < 0)
+		return false;
+	const Entry e = index_.value( name );
+	if (!unchanged( label_file, e.label_size, e.label_mtime ))
+		return false;
+	r.setView( (signed char*)(map_ + e.label_offset), e.width, e.height );
+	return true;
+}
+// Write n bytes followed by zeros up to the next 16 byte boundary (at least
+// 16, the SSE copy of Image reads up to 16 bytes past the end)
+static qint64 writeAligned( QFile & file, const char * data, qint64 n ){
+	const qint64 offset = file.pos();
+	file.write( data, n );
+	const qint64 end = (offset + n + 16 + 15) & ~(qint64)15;
+	file.write( QByteArray( end - offset - n, 0 ) );
+	return offset;
+}
+
+DatasetCacheWriter::~DatasetCacheWriter() {
+	if (file_.isOpen())
+		close();
+}
+bool DatasetCacheWriter::open(const QString& filename) {
+	index_.clear();
+	file_.setFileName( filename );
+	if (!file_.open( QFile::WriteOnly )){
+		qWarning( "Failed to save the dataset cache '%s'", qPrintable( filename ) );
+		return false;
+	}
+	return true;
+}
+void DatasetCacheWriter::add(const QString& name, const ColorImage& image, const QString& image_file, const LabelImage& labels, const QString& label_file) {
+	DatasetCache::Entry e;
+	e.width = image.width();
+	e.height = image.height();
+	e.image_offset = writeAligned( file_, (const char*)image.data(), (qint64)e.width*e.height*sizeof(Color) );
+	stamp( image_file, e.image_size, e.image_mtime );
+	e.label_offset = e.label_size = e.label_mtime = -1;
+	if (labels.width() == e.width && labels.height() == e.height){
+		e.label_offset = writeAligned( file_, (const char*)labels.data(), (qint64)e.width*e.height );
+		stamp( label_file, e.label_size, e.label_mtime );
+	}
+	index_[ name ] = e;
+}
+int DatasetCacheWriter::count() const {
+	return index_.count();
+}
+bool DatasetCacheWriter::close() {
+	QDataStream s( &file_ );
+	const qint64 index_offset = file_.pos();
+	s << index_ << index_offset << CACHE_VERSION << CACHE_MAGIC;
+	const bool ok = s.status() == QDataStream::Ok && file_.error() == QFile::NoError;
+	file_.close();
+	index_.clear();
+	if (!ok)
+		qWarning( "Failed to write the dataset cache '%s'", qPrintable( file_.fileName() ) );
+	return ok;
+}
@@ -0,0 +1,89 @@
+/*
+    Copyright (c) 2011, Philipp Krähenbühl
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+        * Neither the name of the Stanford University nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY Philipp Krähenbühl ''AS IS'' AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL Philipp Krähenbühl BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#pragma once
+
+#include "colorimage.h"
+#include "labelimage.h"
+#include <QFile>
+#include <QMap>
+#include <QString>
+#include <QVector>
+
+// A file with the decoded (raw RGBA) images and labels of a dataset, mapped
+// into memory copy on write. Images are views into the mapping, so opening is
+// instant and all processes using the cache share the same pages. The size
+// and modification time of every source file are stored with it's pixels,
+// images whose file changed since are not used.
+class DatasetCache{
+	friend class DatasetCacheWriter;
+protected:
+	struct Entry{
+		int width, height;
+		// Offset of the labels is -1 if there are none
+		qint64 image_offset, label_offset;
+		// Size and modification time of the source files
+		qint64 image_size, image_mtime, label_size, label_mtime;
+	};
+	friend QDataStream & operator<<( QDataStream & s, const Entry & e );
+	friend QDataStream & operator>>( QDataStream & s, Entry & e );
+	uchar * map_;
+	qint64 size_;
+	QMap< QString, Entry > index_;
+private:
+	DatasetCache( const DatasetCache & o );
+	DatasetCache & operator=( const DatasetCache & o );
+public:
+	DatasetCache();
+	~DatasetCache();
+	bool open( const QString & filename );
+	void close();
+	bool isOpen() const;
+	bool contains( const QString & name ) const;
+	// Make r a view into the mapping (only valid while the cache is open),
+	// returns false if the image (or it's labels) are not cached or the file
+	// it was decoded from changed. Copies of r are deep copies.
+	bool image( const QString & name, const QString & image_file, ColorImage & r ) const;
+	bool labels( const QString & name, const QString & label_file, LabelImage & r ) const;
+};
+
+// Writes a dataset cache one image at a time, the index is written by close
+class DatasetCacheWriter{
+protected:
+	QFile file_;
+	QMap< QString, DatasetCache::Entry > index_;
+public:
+	~DatasetCacheWriter();
+	bool open( const QString & filename );
+	// Append an image and it's labels (if they have the same size), the
+	// files they were decoded from are stamped
+	void add( const QString & name, const ColorImage & image, const QString & image_file, const LabelImage & labels, const QString & label_file );
+	int count() const;
+	// Write the index and the footer
+	bool close();
+};
@@ -26,52 +26,170 @@
 */
 
 #include "image.h"
+
+// Label and texton planes are stored as
+//   -version, W, H, D, codec, qCompress( payload )
+// The negative version takes the place of the width of the old PNG format,
+// so both can be read. The payload is planar (one channel after the other)
+// and little endian, either raw or run length encoded.
+static const int PLANE_VERSION = 1;
+enum PlaneCodec{
+	PLANE_RAW = 0,
+	// (run length as 16 bit, value) pairs
+	PLANE_RLE = 1
+};
+// Fast zlib level, the RLE already removes most of the redundancy
+static const int PLANE_COMPRESSION = 1;
+
+template< typename U >
+static inline void putLE( uchar * p, U v ){
+	for( int b=0; b<(int)sizeof(U); b++ )
+		p[b] = (v >> (8*b)) & 0xff;
+}
+template< typename U >
+static inline U getLE( const uchar * p ){
+	U v = 0;
+	for( int b=0; b<(int)sizeof(U); b++ )
+		v |= (U)p[b] << (8*b);
+	return v;
+}
+template< typename T, typename U >
+static QByteArray encodeRaw( const T * data, int N, int D ){
+	QByteArray r( N*D*sizeof(U), 0 );
+	uchar * p = (uchar*)r.data();
+	for( int k=0; k<D; k++ )
+		for( int i=0; i<N; i++, p+=sizeof(U) )
+			putLE<U>( p, (U)data[i*D+k] );
+	return r;
+}
+// Returns an empty array if the RLE is larger than max_size
+template< typename T, typename U >
+static QByteArray encodeRLE( const T * data, int N, int D, int max_size ){
+	const int pair_size = 2+sizeof(U);
+	QByteArray r( max_size + pair_size, 0 );
+	uchar * p = (uchar*)r.data(), * end = p + max_size;
+	for( int k=0; k<D; k++ )
+		for( int i=0; i<N; ){
+			const T v = data[i*D+k];
+			int n = 1;
+			while( i+n<N && n<0xffff && data[(i+n)*D+k] == v )
+				n++;
+			if (p >= end)
+				return QByteArray();
+			putLE<quint16>( p, n );
+			putLE<U>( p+2, (U)v );
+			p += pair_size;
+			i += n;
+		}
+	r.resize( p - (uchar*)r.data() );
+	return r;
+}
+template< typename T, typename U >
+static void encodePlanes( QDataStream & s, const Image<T> & im ){
+	const int N = im.width()*im.height(), D = im.depth();
+	s << -PLANE_VERSION << im.width() << im.height() << D;
+	QByteArray payload = encodeRLE<T,U>( im.data(), N, D, N*D*sizeof(U) );
+	quint8 codec = PLANE_RLE;
+	if (payload.isEmpty() && N*D > 0){
+		payload = encodeRaw<T,U>( im.data(), N, D );
+		codec = PLANE_RAW;
+	}
+	s << codec << qCompress( payload, PLANE_COMPRESSION );
+}
+template< typename T, typename U >
+static bool decodePlanes( QDataStream & s, int version, T * data, int N, int D ){
+	quint8 codec;
+	QByteArray compressed;
+	s >> codec >> compressed;
+	if (version != PLANE_VERSION || s.status() != QDataStream::Ok){
+		qWarning( "Unsupported image version %d", version );
+		s.setStatus( QDataStream::ReadCorruptData );
+		return false;
+	}
+	if (N*D == 0)
+		return true;
+	const QByteArray payload = qUncompress( compressed );
+	const uchar * p = (const uchar*)payload.constData(), * end = p + payload.size();
+	if (codec == PLANE_RAW && payload.size() == N*D*(int)sizeof(U)){
+		for( int k=0; k<D; k++ )
+			for( int i=0; i<N; i++, p+=sizeof(U) )
+				data[i*D+k] = (T)getLE<U>( p );
+		return true;
+	}
+	if (codec == PLANE_RLE){
+		const int pair_size = 2+sizeof(U);
+		int k = 0, i = 0;
+		for( ; p+pair_size <= end && k<D; p+=pair_size ){
+			const int n = getLE<quint16>( p );
+			const T v = (T)getLE<U>( p+2 );
+			if (i+n > N)
+				break;
+			for( int l=0; l<n; l++, i++ )
+				data[i*D+k] = v;
+			if (i == N){
+				i = 0;
+				k++;
+			}
+		}
+		if (k == D && p == end)
+			return true;
+	}
+	qWarning( "Corrupt image data" );
+	s.setStatus( QDataStream::ReadCorruptData );
+	return false;
+}
+// Old format: the values as ARGB32 pixels of a PNG
+template< typename T >
+static void decodePNG( QDataStream & s, T * data, int W, int H, int D ){
+	QImage sim;
+	sim.load( s.device(), "PNG" );
+	for ( int j=0,k=0; j<H; j++ )
+		for ( int i=0; i<W*D; i++, k++ )
+			data[k] = sim.pixel( i, j );
+}
+
 template<>
 QDataStream& operator<< ( QDataStream& s, const Image< short int >& im )
 {
-    s << im.width_ << im.height_ << im.depth_;
-    QImage sim ( im.width_*im.depth_, im.height_, QImage::Format_ARGB32 );
-    for ( int j=0,k=0; j<im.height_; j++ )
-        for ( int i=0; i<im.width_*im.depth_; i++, k++ )
-            sim.setPixel ( i, j, im.data_[k] );
-    sim.save ( s.device(), "PNG" );
-    return s;
+	encodePlanes<short,quint16>( s, im );
+	return s;
 }
 template<>
 QDataStream& operator>>(QDataStream& s, Image< short int >& im) {
-    int W, H, D;
-    s >> W >> H >> D;
-    im.init( W, H, D );
-
-    QImage sim;
-    sim.load( s.device(), "PNG" );
-
-    for ( int j=0,k=0; j<im.height_; j++ )
-        for ( int i=0; i<im.width_*im.depth_; i++, k++ )
-            im.data_[k] = sim.pixel( i, j );
-    return s;
+	int W, H, D;
+	s >> W;
+	if (W < 0){
+		const int version = -W;
+		s >> W >> H >> D;
+		im.init( W, H, D );
+		decodePlanes<short,quint16>( s, version, im.data_, W*H, D );
+	}
+	else{
+		s >> H >> D;
+		im.init( W, H, D );
+		decodePNG( s, im.data_, W, H, D );
+	}
+	return s;
 }
 template<>
 QDataStream& operator<<(QDataStream& s, const Image< char >& im) {
-    s << im.width_ << im.height_ << im.depth_;
-    QImage sim( im.width_*im.depth_, im.height_, QImage::Format_ARGB32 );
-    for ( int j=0,k=0; j<im.height_; j++ )
-        for ( int i=0; i<im.width_*im.depth_; i++, k++ )
-            sim.setPixel( i, j, im.data_[k] );
-    sim.save( s.device(), "PNG" );
-    return s;
+	encodePlanes<char,quint8>( s, im );
+	return s;
 }
 template<>
 QDataStream& operator>>(QDataStream& s, Image< char >& im) {
-    int W, H, D;
-    s >> W >> H >> D;
-    im.init( W, H, D );
-
-    QImage sim;
-    sim.load( s.device(), "PNG" );
-
-    for ( int j=0,k=0; j<im.height_; j++ )
-        for ( int i=0; i<im.width_*im.depth_; i++, k++ )
-            im.data_[k] = sim.pixel( i, j );
-    return s;
+	int W, H, D;
+	s >> W;
+	if (W < 0){
+		const int version = -W;
+		s >> W >> H >> D;
+		im.init( W, H, D );
+		decodePlanes<char,quint8>( s, version, im.data_, W*H, D );
+	}
+	else{
+		s >> H >> D;
+		im.init( W, H, D );
+		decodePNG( s, im.data_, W, H, D );
+	}
+	return s;
 }
@@ -39,6 +39,9 @@
 #include <xmmintrin.h>
 #endif
 
+// A W x H image with D values per pixel. Images own their data, except views
+// of memory owned by someone else (see setView). Copying a view gives an image
+// with it's own data, so views never spread beyond the code that created them.
 template< typename T >
 class Image{
 template< typename TT >
@@ -48,80 +51,71 @@ template< typename TT >
 protected:
 	T * data_;
 	int width_, height_, depth_;
-	virtual void init( int W, int H, int D=1 ){
-		if (W != width_ || H != height_ || D != depth_){
-			width_ = W;
-			height_ = H;
-			depth_ = D;
+	// data_ belongs to someone else (e.g. a memory mapped file)
+	bool view_;
+	void allocate(){
+		if (width_*height_*depth_ > 0)
 #ifdef __SSE__
-			if (data_)
-				_mm_free( data_ );
 			data_ = (T*) _mm_malloc( width_*height_*depth_*sizeof(T)+16, 16 );
 #else
-			if (data_)
-				delete[] data_;
 			data_ = new T[ width_*height_*depth_ ];
 #endif
-		}
+		else
+			data_ = NULL;
 	}
-public:
-	explicit Image( int w=0, int h=0, int d=1 ):width_(w),height_(h),depth_(d){
-		if (width_*height_*depth_ > 0){
+	void release(){
+		if (data_ && !view_)
 #ifdef __SSE__
-			data_ = (T*) _mm_malloc( width_*height_*depth_*sizeof(T)+16, 16 );
+			_mm_free( data_ );
 #else
-			data_ = new T[ width_*height_*depth_ ];
+			delete [] data_;
 #endif
-			bzero( data_, sizeof( T )*width_*height_*depth_ );
+		data_ = NULL;
+		view_ = false;
+	}
+	virtual void init( int W, int H, int D=1 ){
+		if (view_ || W != width_ || H != height_ || D != depth_){
+			release();
+			width_ = W;
+			height_ = H;
+			depth_ = D;
+			allocate();
 		}
-		else
-			data_ = NULL;
 	}
-	Image( const Image<T> & o ):width_(o.width_),height_(o.height_),depth_(o.depth_){
-		if (width_*height_*depth_ > 0){
+public:
+	explicit Image( int w=0, int h=0, int d=1 ):width_(w),height_(h),depth_(d),view_(false){
+		allocate();
+		if (data_)
+			bzero( data_, sizeof( T )*width_*height_*depth_ );
+	}
+	// Copies are always deep (also copies of views)
+	Image( const Image<T> & o ):width_(o.width_),height_(o.height_),depth_(o.depth_),view_(false){
+		allocate();
+		if (data_){
 #ifdef __SSE__
-			data_ = (T*) _mm_malloc( width_*height_*depth_*sizeof(T)+16, 16 );
 			__m128i * a = (__m128i*) data_, *b = (__m128i*) o.data_;
 			for( int i=0; i<width_*height_*depth_; i+=sizeof(__m128i)/sizeof(T), a++, b++ )
 				*a = *b;
 #else
-			data_ = new T[ width_*height_*depth_ ];
 			std::copy( o.data_, o.data_+width_*height_*depth_, data_ );
 #endif
 		}
-		else
-			data_ = NULL;
 	}
 	virtual ~Image(){
-		if (data_)
-#ifdef __SSE__
-			_mm_free( data_);
-#else
-			delete [] data_;
-#endif
+		release();
 	}
 	Image & operator=( const Image & o ){
-		if (width_ != o.width_ || height_ != o.height_ || depth_ != o.depth_) {
+		if (this == &o)
+			return *this;
+		// Assigning to a view copies into memory of it's own
+		if (view_ || width_ != o.width_ || height_ != o.height_ || depth_ != o.depth_) {
+			release();
 			width_  = o.width_;
 			height_ = o.height_;
 			depth_ = o.depth_;
-			if (data_)
-#ifdef __SSE__
-				_mm_free( data_);
-#else
-				delete [] data_;
-#endif
-			
-			if (width_*height_*depth_ > 0)
-#ifdef __SSE__
-				data_ = (T*) _mm_malloc( width_*height_*depth_*sizeof(T)+16, 16 );
-#else
-				data_ = new T[ width_*height_*depth_ ];
-#endif
-			else
-				data_ = NULL;
+			allocate();
 		}
-		if (width_*height_*depth_ > 0){
+		if (data_){
 #ifdef __SSE__
 			__m128i * a = (__m128i*) data_, *b = (__m128i*) o.data_;
 			for( int i=0; i<width_*height_*depth_; i+=sizeof(__m128i)/sizeof(T), a++, b++ )
@@ -132,6 +126,20 @@ public:
 		}
 		return *this;
 	}
+	// Use W*H*D values at data without copying, data has to be 16 byte
+	// aligned and outlive the image. Views are the only images that share
+	// memory, copies and assignments of a view own their data.
+	void setView( T * data, int W, int H, int D=1 ){
+		release();
+		width_ = W;
+		height_ = H;
+		depth_ = D;
+		data_ = data;
+		view_ = true;
+	}
+	bool isView() const{
+		return view_;
+	}
 public: // data access
 	int width() const{
 		return width_;
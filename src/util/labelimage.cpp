@@ -28,6 +28,7 @@
 #include "labelimage.h"
 #include <QImage>
 #include <QMap>
+#include <QVector>
 #include "colorimage.h"
 static QMap< unsigned int, signed char > init_msrc(){
 	QMap< unsigned int, signed char > color_to_id;
@@ -118,32 +119,120 @@ static QMap< signed char, unsigned int > MSRC_COLORS = init_msrc_colors();
 static QMap< signed char, unsigned int > VOC2007_COLORS = init_voc2007_colors();
 static QMap< signed char, unsigned int > VOC2010_COLORS = init_voc2010_colors();
 
+// Flat lookup table of a color map. Indices (< 256) are looked up directly,
+// rgb colors through a perfect hash (one multiply and shift, no collisions).
+class LabelLUT{
+protected:
+	signed char index_[256];
+	bool index_known_[256];
+	QVector< unsigned int > keys_;
+	QVector< signed char > values_;
+	QVector< bool > known_;
+	unsigned int mul_;
+	int shift_;
+	unsigned int slot( unsigned int c ) const{
+		return (c*mul_) >> shift_;
+	}
+	bool build( const QMap< unsigned int, signed char >& map, int bits, unsigned int mul ){
+		mul_ = mul;
+		shift_ = 32-bits;
+		keys_.fill( 0, 1<<bits );
+		values_.fill( -1, 1<<bits );
+		known_.fill( false, 1<<bits );
+		foreach( unsigned int c, map.keys() ){
+			unsigned int s = slot( c );
+			if (known_[s])
+				return false;
+			keys_[s] = c;
+			values_[s] = map[c];
+			known_[s] = true;
+		}
+		return true;
+	}
+public:
+	LabelLUT( const QMap< unsigned int, signed char >& map ){
+		for( int i=0; i<256; i++ ){
+			index_known_[i] = map.contains( i );
+			index_[i] = index_known_[i] ? map[i] : -1;
+		}
+		// Search a multiplier without collisions, growing the table if needed
+		int bits = 1;
+		while( (1<<bits) < 2*map.count() )
+			bits++;
+		unsigned int mul = 0x9E3779B1;
+		for( ; bits<=16; bits++ )
+			for( int t=0; t<1000; t++, mul = mul*1664525 + 1013904223 )
+				if (build( map, bits, mul | 1 ))
+					return;
+		qFatal( "No perfect hash found for the label colors" );
+	}
+	// Both set l to -1 for unknown colors
+	bool index( unsigned int i, signed char & l ) const{
+		const bool known = i < 256 && index_known_[i];
+		l = known ? index_[i] : -1;
+		return known;
+	}
+	bool color( unsigned int c, signed char & l ) const{
+		const unsigned int s = slot( c );
+		const bool known = known_[s] && keys_[s] == c;
+		l = known ? values_[s] : -1;
+		return known;
+	}
+};
+static const LabelLUT MSRC_LUT( MSRC_MAP );
+static const LabelLUT VOC2007_LUT( VOC2007_MAP );
+static const LabelLUT VOC2010_LUT( VOC2010_MAP );
+
 void LabelImage::init(const QImage& qim, LabelType type) {
 	if( type == MSRC )
-		init( qim, MSRC_MAP );
+		init( qim, MSRC_LUT );
 	else if( type == VOC2007 )
-		init( qim, VOC2007_MAP );
+		init( qim, VOC2007_LUT );
 	else if( type == VOC2010 )
-		init( qim, VOC2010_MAP );
+		init( qim, VOC2010_LUT );
 	else
 		qWarning( "Unsupported Label type" );
 
 }
 void LabelImage::init(const QImage& qim, const QMap< unsigned int, signed char >& map) {
-	if (qim.width() != width_ || qim.height() != height_)
-		Image< signed char >::init( qim.width(), qim.height() );
+	init( qim, LabelLUT( map ) );
+}
+void LabelImage::init(const QImage& qim, const LabelLUT& lut) {
+	// Reallocates views (and nothing else of the same size)
+	Image< signed char >::init( qim.width(), qim.height() );
 	bool use_index = qim.depth() < 24;
-	for( int j=0; j<qim.height(); j++ )
-		for( int i=0; i<qim.width(); i++ ){
-			unsigned int p = use_index ? qim.pixelIndex(i, j) : qim.pixel( i, j );
-			if ( map.contains( p ) )
-				(*this)(i,j) = map[ p ];
-			else
-				if (use_index)
-					qWarning( "Color not found in map: %d !", p );
-				else
-					qWarning( "Color not found in map: %x !", p );
+	// Unknown colors are unlabeled (-1), reported once per image
+	int n_unknown = 0;
+	unsigned int unknown = 0;
+	for( int j=0; j<qim.height(); j++ ){
+		signed char * r = data_ + j*width_;
+		if (qim.format() == QImage::Format_Indexed8){
+			const uchar * line = qim.scanLine( j );
+			for( int i=0; i<qim.width(); i++ )
+				if (!lut.index( line[i], r[i] ) && !n_unknown++)
+					unknown = line[i];
 		}
+		else if (qim.format() == QImage::Format_RGB32 || qim.format() == QImage::Format_ARGB32){
+			// RGB32 is 0xffRRGGBB, just as pixel() returns it
+			const unsigned int alpha = qim.format() == QImage::Format_RGB32 ? 0xff000000 : 0;
+			const QRgb * line = (const QRgb *)qim.scanLine( j );
+			for( int i=0; i<qim.width(); i++ )
+				if (!lut.color( line[i] | alpha, r[i] ) && !n_unknown++)
+					unknown = line[i] | alpha;
+		}
+		else
+			for( int i=0; i<qim.width(); i++ ){
+				unsigned int p = use_index ? qim.pixelIndex(i, j) : qim.pixel( i, j );
+				if (!(use_index ? lut.index( p, r[i] ) : lut.color( p, r[i] )) && !n_unknown++)
+					unknown = p;
+			}
+	}
+	if (n_unknown){
+		if (use_index)
+			qWarning( "Color not found in map: %d (%d pixels) !", unknown, n_unknown );
+		else
+			qWarning( "Color not found in map: %x (%d pixels) !", unknown, n_unknown );
+	}
 }
 LabelImage::LabelImage(int w, int h) : Image< signed char >( w, h ) {
 }
@@ -38,9 +38,11 @@ template<class Key, class T >
 class QMap;
 class QImage;
 class ColorImage;
+class LabelLUT;
 class LabelImage: public Image< signed char >
 {
 	void init( const QImage& qim, const QMap< unsigned int, signed char >& map );
+	void init( const QImage& qim, const LabelLUT& lut );
 	void init( const QImage& qim, LabelType type );
 public:
 	explicit LabelImage(int w = 0, int h = 0);
@@ -29,6 +29,7 @@
 #include "settings.h"
 #include "colorimage.h"
 #include "labelimage.h"
+#include "dataset.h"
 #include <QVector>
 #include <QString>
 #include <QFileInfo>
@@ -56,24 +57,6 @@ static QVector< QString > listMSRC( int type ){
 	return names;
 }
 
-void loadMSRC(QVector< ColorImage >& images, QVector< LabelImage >& annotations, QVector< QString > & names, int type) {
-	QVector< QString > filenames = listMSRC( type );
-	images.clear();
-	annotations.clear();
-	names.clear();
-	foreach (QString name, filenames ){
-		QString gtname = name;
-		gtname.replace(".bmp", "_GT.bmp");
-		ColorImage im;
-		LabelImage gt;
-		im.load( name );
-		gt.load( gtname, MSRC );
-		images.append( im );
-		annotations.append( gt );
-		names.append( QFileInfo( name ).baseName() );
-	}
-}
-
 static QVector< QString > listVOC2010( int type ){
 	QString base_dir = VOC2010_DIRECTORY;
 	QVector< QString > names;
@@ -97,31 +80,21 @@ static QVector< QString > listVOC2010( int type ){
 	return names;
 }
 
-void loadVOC2010(QVector< ColorImage >& images, QVector< LabelImage >& annotations, QVector< QString > & names, int type) {
-	QVector< QString > filenames = listVOC2010( type );
-	images.clear();
-	annotations.clear();
-	names.clear();
-	foreach (QString name, filenames ){
-		QString pngname = name;
-		QString gtname = name;
-		pngname+=".png";
-		gtname.replace("/PNGImages/", "/SegmentationClass/");
-		gtname+=".png";
-		ColorImage im;
-		LabelImage gt;
-		im.load( pngname );
-		gt.load( gtname, VOC2010 );
-		images.append( im );
-		annotations.append( gt );
-		names.append( QFileInfo( name ).baseName() );
-	}
+void loadImages(QVector< ColorImage >& images, QVector< LabelImage >& annotations, QVector< QString > & names, int type, bool use_cache) {
+	Dataset dataset( type, Dataset::IMAGES_AND_LABELS, use_cache );
+	images = dataset.images();
+	annotations = dataset.labels();
+	names = dataset.names();
 }
-
-void loadImages(QVector< ColorImage >& images, QVector< LabelImage >& annotations, QVector< QString > & names, int type) {
+void listImages(QVector< QString >& image_files, QVector< QString >& names, int type) {
 #ifdef USE_MSRC
-	loadMSRC(images, annotations, names, type);
+	image_files = listMSRC( type );
 #else
-	loadVOC2010(images, annotations, names, type);    
+	image_files = listVOC2010( type );
+	for( int i=0; i<image_files.count(); i++ )
+		image_files[i] += ".png";
 #endif
-}
\ No newline at end of file
+	names.clear();
+	foreach (QString name, image_files )
+		names.append( QFileInfo( name ).baseName() );
+}
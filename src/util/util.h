@@ -41,6 +41,8 @@ enum DataType{
 	ALL=7
 };
 
-// void loadMSRC( QVector< ColorImage >& images, QVector< LabelImage >& annotations, QVector< QString > & names, int type );
-// void loadVOC2010( QVector< ColorImage >& images, QVector< LabelImage >& annotations, QVector< QString > & names, int type );
-void loadImages( QVector< ColorImage >& images, QVector< LabelImage >& annotations, QVector< QString > & names, int type );
\ No newline at end of file
+// Decode all images and labels of a split at once (see Dataset to decode on
+// demand). Cached images are views into the dataset cache (see DATASET_CACHE).
+void loadImages( QVector< ColorImage >& images, QVector< LabelImage >& annotations, QVector< QString > & names, int type, bool use_cache = true );
+// List the image files and names of loadImages without loading them
+void listImages( QVector< QString > & image_files, QVector< QString > & names, int type );
\ No newline at end of file
@@ -1,5 +1,6 @@
 TEXTONIZE=build/src/textonize
-$TEXTONIZE data/msrc_filterbank.dat FilterBank 400
-$TEXTONIZE data/msrc_color.dat Color 128
-$TEXTONIZE data/msrc_hog_l.dat HoG 150 L
-$TEXTONIZE data/msrc_location.dat Location 144
+# All features share one pass over the images
+$TEXTONIZE --feature filterbank 400 data/msrc_filterbank.dat \
+           --feature color 128 data/msrc_color.dat \
+           --feature hog:l 150 data/msrc_hog_l.dat \
+           --feature location 144 data/msrc_location.dat